@@ -0,0 +1,48 @@
+#include "Allocations.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocations(0);
+
+uint64_t allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+// What the standard operator new does (retry through the new handler, then throw), plus the count
+static void* allocate(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    while (true) {
+        if (void* p = std::malloc(size)) return p;
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+static void* allocate(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+/*************************************************************
+                    Replaced global operators
+ *************************************************************/
+
+void* operator new(size_t size)                                     { return allocate(size); }
+void* operator new[](size_t size)                                   { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t& t) noexcept   { return allocate(size, t); }
+void* operator new[](size_t size, const std::nothrow_t& t) noexcept { return allocate(size, t); }
+
+void operator delete(void* p) noexcept                              { std::free(p); }
+void operator delete[](void* p) noexcept                            { std::free(p); }
+void operator delete(void* p, size_t) noexcept                      { std::free(p); }
+void operator delete[](void* p, size_t) noexcept                    { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept       { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept     { std::free(p); }
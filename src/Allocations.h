@@ -0,0 +1,11 @@
+#ifndef OPENGL_ALLOCATIONS_H
+#define OPENGL_ALLOCATIONS_H
+
+#include <cstdint>
+
+// The global operator new is replaced by one that counts its calls (on every thread), so that the frame loop can
+// check it doesn't allocate: once the scene is loaded, a frame should only use memory it already has & the frame
+// arena (see Arena.h). The count is a relaxed atomic increment, cheap enough to always be on
+uint64_t allocationCount();
+
+#endif //OPENGL_ALLOCATIONS_H
@@ -0,0 +1,246 @@
+#include "Archive.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*************************************************************
+                        Archive files
+ *************************************************************/
+
+bool mapArchive(const string& path, uint32_t magic, uint32_t version, MappedArchive& archive) {
+    unmapArchive(archive);
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(ArchiveHeader)) {
+        close(fd);
+        return false;
+    }
+
+    // The mapping stays valid after the file is closed
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    archive.data = (const unsigned char*) data;
+    archive.size = info.st_size;
+
+    const ArchiveHeader* header = (const ArchiveHeader*) archive.data;
+    bool ok = header->magic == magic && header->version == version
+              && header->namesOffset == sizeof(ArchiveHeader) + (uint64_t) header->numEntries * sizeof(ArchiveEntry)
+              && header->namesOffset + header->namesSize <= archive.size;
+    archive.entries = (const ArchiveEntry*) (archive.data + sizeof(ArchiveHeader));
+    archive.names = (const char*) (archive.data + header->namesOffset);
+    archive.numEntries = ok ? header->numEntries : 0;
+    for (uint32_t i = 0; ok && i < archive.numEntries; i++) {
+        const ArchiveEntry& entry = archive.entries[i];
+        ok = (uint64_t) entry.nameOffset + entry.nameLength <= header->namesSize
+             && entry.offset <= archive.size && entry.storedSize <= archive.size - entry.offset
+             && ((entry.flags & ARCHIVE_LZ4) || entry.storedSize == entry.size);
+    }
+
+    if (!ok) unmapArchive(archive);
+    return ok;
+}
+
+void unmapArchive(MappedArchive& archive) {
+    if (archive.data) munmap((void*) archive.data, archive.size);
+    archive = MappedArchive();
+}
+
+// Binary search of the (sorted) table of contents
+const ArchiveEntry* findArchiveEntry(const MappedArchive& archive, const string& name) {
+    if (!archive.data) return nullptr;
+
+    const char* names = archive.names;
+    const ArchiveEntry* first = archive.entries;
+    const ArchiveEntry* last = archive.entries + archive.numEntries;
+    const ArchiveEntry* it = lower_bound(first, last, name, [names](const ArchiveEntry& entry, const string& key) {
+        return key.compare(0, string::npos, names + entry.nameOffset, entry.nameLength) > 0;
+    });
+    if (it == last || name.compare(0, string::npos, names + it->nameOffset, it->nameLength) != 0) return nullptr;
+    return it;
+}
+
+static uint64_t alignUp(uint64_t v) {
+    return (v + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+}
+
+bool writeArchive(const string& path, uint32_t magic, uint32_t version, vector<ArchiveInput>& inputs) {
+    sort(inputs.begin(), inputs.end(), [](const ArchiveInput& a, const ArchiveInput& b) { return a.name < b.name; });
+
+    // Lay out the table of contents, the names & then the blobs
+    ArchiveHeader header = { magic, version, (uint32_t) inputs.size(), 0, 0, 0 };
+    vector<ArchiveEntry> entries(inputs.size());
+    string names;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        entries[i].nameOffset = names.size();
+        entries[i].nameLength = inputs[i].name.size();
+        names += inputs[i].name;
+    }
+    header.namesOffset = sizeof(ArchiveHeader) + entries.size() * sizeof(ArchiveEntry);
+    header.namesSize = names.size();
+
+    uint64_t offset = alignUp(header.namesOffset + header.namesSize);
+    for (size_t i = 0; i < inputs.size(); i++) {
+        entries[i].offset = offset;
+        entries[i].size = inputs[i].size;
+        entries[i].storedSize = inputs[i].data.size();
+        entries[i].mtime = inputs[i].mtime;
+        entries[i].flags = inputs[i].flags;
+        entries[i].pad = 0;
+        offset = alignUp(offset + inputs[i].data.size());
+    }
+
+    string tmp = path + ".tmp";
+    ofstream out(tmp, ios::binary);
+    if (!out) return false;
+    out.write((const char*) &header, sizeof(header));
+    out.write((const char*) entries.data(), entries.size() * sizeof(ArchiveEntry));
+    out.write(names.data(), names.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        static const char zeros[ARCHIVE_ALIGNMENT] = {};
+        out.write(zeros, entries[i].offset - out.tellp());
+        out.write((const char*) inputs[i].data.data(), inputs[i].data.size());
+    }
+    out.close();
+
+    if (!out || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*************************************************************
+                            LZ4
+ *************************************************************/
+
+// LZ4 block format: a sequence is a token (literal length << 4 | match length - 4), the literals,
+// a 2 byte little endian offset back into the output & the match. Lengths of 15 or more continue
+// in extra bytes of 255 until a smaller byte. The last sequence is only literals
+static const int MIN_MATCH = 4;
+static const int LAST_LITERALS = 5;         // the format requires the last 5 bytes to be literals...
+static const int MATCH_START_LIMIT = 12;    // ...and the last match to start 12 bytes before the end
+static const int MAX_OFFSET = 65535;
+static const int HASH_BITS = 16;
+
+static uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void writeLength(vector<unsigned char>& out, size_t length) {
+    for (; length >= 255; length -= 255) out.push_back(255);
+    out.push_back((unsigned char) length);
+}
+
+static void writeSequence(vector<unsigned char>& out, const unsigned char* literals, size_t numLiterals,
+                          size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength - MIN_MATCH;
+    unsigned char token = (unsigned char) ((min(numLiterals, (size_t) 15) << 4) | min(matchCode, (size_t) 15));
+    out.push_back(token);
+    if (numLiterals >= 15) writeLength(out, numLiterals - 15);
+    out.insert(out.end(), literals, literals + numLiterals);
+
+    out.push_back((unsigned char) (offset & 0xff));
+    out.push_back((unsigned char) (offset >> 8));
+    if (matchCode >= 15) writeLength(out, matchCode - 15);
+}
+
+static void writeLastLiterals(vector<unsigned char>& out, const unsigned char* literals, size_t numLiterals) {
+    out.push_back((unsigned char) (min(numLiterals, (size_t) 15) << 4));
+    if (numLiterals >= 15) writeLength(out, numLiterals - 15);
+    out.insert(out.end(), literals, literals + numLiterals);
+}
+
+// Greedy matching against the last position each 4 byte sequence was seen at
+size_t lz4Compress(const unsigned char* src, size_t size, vector<unsigned char>& out) {
+    out.clear();
+    out.reserve(size + size / 255 + 16);
+
+    size_t anchor = 0;
+    if (size > MATCH_START_LIMIT) {
+        vector<int64_t> table(1 << HASH_BITS, -1);
+        size_t matchEnd = size - LAST_LITERALS;
+
+        for (size_t i = 0; i + MATCH_START_LIMIT < size; ) {
+            uint32_t sequence = read32(src + i);
+            uint32_t h = hash4(sequence);
+            int64_t ref = table[h];
+            table[h] = i;
+
+            if (ref < 0 || i - ref > MAX_OFFSET || read32(src + ref) != sequence) {
+                i++;
+                continue;
+            }
+
+            size_t length = MIN_MATCH;
+            while (i + length < matchEnd && src[ref + length] == src[i + length]) length++;
+
+            writeSequence(out, src + anchor, i - anchor, i - ref, length);
+            i += length;
+            anchor = i;
+        }
+    }
+    writeLastLiterals(out, src + anchor, size - anchor);
+
+    return (out.size() < size) ? out.size() : 0;
+}
+
+static bool readLength(const unsigned char* src, size_t storedSize, size_t& in, size_t& length) {
+    unsigned char b;
+    do {
+        if (in >= storedSize) return false;
+        b = src[in++];
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+bool lz4Decompress(const unsigned char* src, size_t storedSize, unsigned char* dst, size_t size) {
+    size_t in = 0, out = 0;
+    while (in < storedSize) {
+        unsigned char token = src[in++];
+
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15 && !readLength(src, storedSize, in, numLiterals)) return false;
+        if (numLiterals > storedSize - in || numLiterals > size - out) return false;
+        memcpy(dst + out, src + in, numLiterals);
+        in += numLiterals;
+        out += numLiterals;
+
+        if (in == storedSize) break;    // the last sequence has no match
+
+        if (storedSize - in < 2) return false;
+        size_t offset = src[in] | (src[in + 1] << 8);
+        in += 2;
+        if (offset == 0 || offset > out) return false;
+
+        size_t length = token & 15;
+        if (length == 15 && !readLength(src, storedSize, in, length)) return false;
+        length += MIN_MATCH;
+        if (length > size - out) return false;
+
+        // Byte by byte, since the match can overlap the bytes it's producing
+        const unsigned char* match = dst + out - offset;
+        for (size_t k = 0; k < length; k++) dst[out + k] = match[k];
+        out += length;
+    }
+    return out == size;
+}
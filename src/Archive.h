@@ -0,0 +1,79 @@
+#ifndef OPENGL_ARCHIVE_H
+#define OPENGL_ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout of the packed asset archive (written by tools/pack.cpp, read through Assets.h) & of
+// the scene snapshot (see Snapshot.h), which uses its own magic number:
+//
+//   ArchiveHeader
+//   ArchiveEntry[numEntries]       sorted by name, so a lookup is a binary search
+//   names                          the entries' paths, not null terminated
+//   blobs                          each starting on an ARCHIVE_ALIGNMENT boundary
+//
+// The whole file is mapped into memory at runtime, so an uncompressed blob is handed to the decoders in place
+
+static const uint32_t ARCHIVE_MAGIC = 0x4b434150;      // "PACK"
+static const uint32_t ARCHIVE_VERSION = 1;
+static const uint32_t ARCHIVE_ALIGNMENT = 64;           // a cache line
+
+enum ArchiveFlags {
+    ARCHIVE_LZ4 = 1 << 0,   // the blob is an LZ4 block that decompresses to `size` bytes
+};
+
+struct ArchiveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numEntries;
+    uint32_t pad;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+struct ArchiveEntry {
+    uint64_t offset;        // of the blob, from the start of the file
+    uint64_t size;          // of the original file
+    uint64_t storedSize;    // of the blob
+    int64_t mtime;          // of the original file (so caches keyed on it stay valid)
+    uint32_t nameOffset;    // into the names
+    uint32_t nameLength;
+    uint32_t flags;
+    uint32_t pad;
+};
+
+// An archive mapped into memory
+struct MappedArchive {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    const ArchiveEntry* entries = nullptr;
+    const char* names = nullptr;
+    uint32_t numEntries = 0;
+};
+
+// Maps the file & checks its whole table of contents, so lookups can trust it
+bool mapArchive(const std::string& path, uint32_t magic, uint32_t version, MappedArchive&);
+void unmapArchive(MappedArchive&);
+const ArchiveEntry* findArchiveEntry(const MappedArchive&, const std::string& name);
+
+// An entry to be written
+struct ArchiveInput {
+    std::string name;
+    std::vector<unsigned char> data;    // as stored (LZ4 compressed if the flag is set)
+    uint64_t size;                      // uncompressed
+    int64_t mtime;
+    uint32_t flags;
+};
+
+// Sorts the entries by name & writes the file (through a temporary, so a reader never sees half of it)
+bool writeArchive(const std::string& path, uint32_t magic, uint32_t version, std::vector<ArchiveInput>&);
+
+// LZ4 block format (no frame header): returns the compressed size, or 0 if the data didn't get any smaller
+size_t lz4Compress(const unsigned char* src, size_t size, std::vector<unsigned char>& out);
+
+// Decompresses exactly `size` bytes into dst, checking every length against both buffers
+bool lz4Decompress(const unsigned char* src, size_t storedSize, unsigned char* dst, size_t size);
+
+#endif //OPENGL_ARCHIVE_H
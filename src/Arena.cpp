@@ -0,0 +1,38 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+static char* align(char* p, size_t alignment) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(p);
+    return p + (alignment - address % alignment) % alignment;
+}
+
+FrameArena::FrameArena() : _memory(new char[INITIAL_CAPACITY]), _capacity(INITIAL_CAPACITY), _used(0), _peak(0) {}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+    // Room to align the start wherever it lands, so that allocating is a single atomic add on any thread
+    size_t size = bytes + alignment - 1;
+    size_t offset = _used.fetch_add(size);
+    if (offset + size <= _capacity)
+        return align(_memory.get() + offset, alignment);
+
+    lock_guard<mutex> guard(_overflowLock);
+    _overflow.emplace_back(new char[size]);
+    return align(_overflow.back().get(), alignment);
+}
+
+void FrameArena::reset() {
+    size_t used = _used;
+    _peak = max(_peak, used);
+
+    // One block big enough for the frame that overflowed, with room to spare
+    if (used > _capacity) {
+        _capacity = max(used + used / 2, _capacity * 2);
+        _memory.reset(new char[_capacity]);
+    }
+    _overflow.clear();
+    _used = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef OPENGL_ARENA_H
+#define OPENGL_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for the data that only lives for a frame (draw lists, instance data...): allocating just bumps an
+// offset, & everything is freed at once when the next frame resets it. It never runs destructors, so it only holds
+// trivially destructible types. Allocating is thread-safe (jobs allocate too), resetting isn't.
+// A frame that needs more than the capacity gets the rest from the heap, & the arena grows to fit at the next reset
+class FrameArena {
+    /********* Configurable settings *********/
+    const size_t INITIAL_CAPACITY = 1 << 20;    // bytes
+    /*****************************************/
+
+    std::unique_ptr<char[]> _memory;
+    size_t _capacity;
+    std::atomic<size_t> _used;      // runs past _capacity by what overflowed to the heap
+
+    std::mutex _overflowLock;
+    std::vector<std::unique_ptr<char[]>> _overflow;
+
+    size_t _peak;       // the most any frame has used
+
+public:
+    FrameArena();
+
+    // Uninitialized memory, valid until the next reset
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "the frame arena doesn't run destructors");
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Frees everything allocated since the last reset (nothing may be using it anymore)
+    void reset();
+
+    // Accessors (bytes)
+    size_t used() { return _used; };
+    size_t capacity() { return _capacity; };
+    size_t peak() { return _peak; };
+};
+
+#endif //OPENGL_ARENA_H
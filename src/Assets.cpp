@@ -0,0 +1,182 @@
+#include "Assets.h"
+#include "Archive.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// The mounted archive
+static MappedArchive archive;
+
+// I/O accounting (readAsset is called from the texture prefetch threads too)
+static atomic<uint64_t> mappedReads(0), unpackedReads(0), looseReads(0);
+static atomic<uint64_t> bytesRead(0), readNanoseconds(0);
+
+// Assimp & the material files produce paths like "assets/nanosuit/./arm.png" or with backslashes
+static string normalize(const string& path) {
+    string result = path;
+    replace(result.begin(), result.end(), '\\', '/');
+
+    size_t pos;
+    while ((pos = result.find("/./")) != string::npos) result.erase(pos, 2);
+    while ((pos = result.find("//")) != string::npos) result.erase(pos, 1);
+    while (result.compare(0, 2, "./") == 0) result.erase(0, 2);
+    return result;
+}
+
+bool mountArchive(const string& path) {
+    unmountArchive();
+    if (mapArchive(path, ARCHIVE_MAGIC, ARCHIVE_VERSION, archive)) return true;
+
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0)
+        cerr << "Error: " << path << " isn't a valid asset archive (version " << ARCHIVE_VERSION << ")" << endl;
+    return false;
+}
+
+void unmountArchive() {
+    unmapArchive(archive);
+}
+
+bool archiveMounted() {
+    return archive.data != nullptr;
+}
+
+static const ArchiveEntry* findEntry(const string& path) {
+    return archive.data ? findArchiveEntry(archive, normalize(path)) : nullptr;
+}
+
+AssetData readAsset(const string& path) {
+    auto start = chrono::high_resolution_clock::now();
+    AssetData asset;
+
+    if (const ArchiveEntry* entry = findEntry(path)) {
+        const unsigned char* blob = archive.data + entry->offset;
+        if (entry->flags & ARCHIVE_LZ4) {
+            asset._storage.resize(entry->size);
+            asset._valid = lz4Decompress(blob, entry->storedSize, asset._storage.data(), entry->size);
+            if (!asset._valid) cerr << "Error: corrupt archive entry " << path << endl;
+            unpackedReads++;
+        } else {
+            asset._data = blob;
+            asset._size = entry->size;
+            asset._valid = true;
+            mappedReads++;
+        }
+    } else {
+        // Not in the archive (or none is mounted)
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd >= 0 && fstat(fd, &info) == 0) {
+            asset._storage.resize(info.st_size);
+            size_t got = 0;
+            ssize_t n = 1;
+            while (got < asset._storage.size() && (n = read(fd, asset._storage.data() + got, asset._storage.size() - got)) > 0)
+                got += n;
+            asset._valid = (got == asset._storage.size());
+            looseReads++;
+        }
+        if (fd >= 0) close(fd);
+    }
+
+    if (!asset._storage.empty() || !asset._data) {
+        asset._data = asset._storage.data();
+        asset._size = asset._storage.size();
+    }
+    if (asset._valid) bytesRead += asset._size;
+
+    chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - start;
+    readNanoseconds += (uint64_t) elapsed.count();
+    return asset;
+}
+
+bool assetExists(const string& path) {
+    if (findEntry(path)) return true;
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+bool assetStamp(const string& path, int64_t& size, int64_t& mtime) {
+    if (const ArchiveEntry* entry = findEntry(path)) {
+        size = entry->size;
+        mtime = entry->mtime;
+        return true;
+    }
+
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return false;
+    size = info.st_size;
+    mtime = info.st_mtime;
+    return true;
+}
+
+void reportAssetIO() {
+    cout << "Asset I/O: " << (archive.data ? "archive mapped" : "no archive") << ", "
+         << mappedReads << " mapped, " << unpackedReads << " decompressed, " << looseReads << " loose file reads, "
+         << bytesRead / 1024 << "KB in " << readNanoseconds / 1000000.0 << "ms" << endl;
+}
+
+/*************************************************************
+                        Assimp I/O
+ *************************************************************/
+
+// A read-only stream over an asset's bytes
+class AssetStream : public Assimp::IOStream {
+    AssetData _asset;
+    size_t _position;
+
+public:
+    explicit AssetStream(AssetData&& asset) : _asset(std::move(asset)), _position(0) {};
+
+    size_t Read(void* buffer, size_t size, size_t count) override {
+        if (size == 0) return 0;
+        size_t available = (_asset.size() - _position) / size;
+        count = min(count, available);
+        memcpy(buffer, _asset.data() + _position, size * count);
+        _position += size * count;
+        return count;
+    }
+
+    size_t Write(const void*, size_t, size_t) override { return 0; };
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override {
+        size_t target;
+        switch (origin) {
+            case aiOrigin_SET:  target = offset; break;
+            case aiOrigin_CUR:  target = _position + offset; break;
+            case aiOrigin_END:  target = _asset.size() - offset; break;
+            default:            return aiReturn_FAILURE;
+        }
+        if (target > _asset.size()) return aiReturn_FAILURE;
+        _position = target;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override        { return _position; };
+    size_t FileSize() const override    { return _asset.size(); };
+    void Flush() override               {};
+};
+
+bool AssetIOSystem::Exists(const char* path) const {
+    return assetExists(path);
+}
+
+Assimp::IOStream* AssetIOSystem::Open(const char* path, const char* mode) {
+    if (strchr(mode, 'w') || strchr(mode, 'a')) return nullptr;   // assets are read-only
+
+    AssetData asset = readAsset(path);
+    if (!asset.valid()) return nullptr;
+    _opened.push_back(normalize(path));
+    return new AssetStream(std::move(asset));
+}
+
+void AssetIOSystem::Close(Assimp::IOStream* stream) {
+    delete stream;
+}
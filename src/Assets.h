@@ -0,0 +1,61 @@
+#ifndef OPENGL_ASSETS_H
+#define OPENGL_ASSETS_H
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Every asset is read through here: from the packed archive (see Archive.h) when one is mounted,
+// otherwise from the loose file. Paths are the same either way, ie "assets/crate.jpeg"
+
+// The bytes of an asset. An uncompressed archive entry is a view straight into the mapped archive,
+// anything else (LZ4 entries, loose files) owns its bytes
+class AssetData {
+    const unsigned char* _data;
+    size_t _size;
+    std::vector<unsigned char> _storage;
+    bool _valid;
+
+    friend AssetData readAsset(const std::string&);
+
+public:
+    AssetData() : _data(nullptr), _size(0), _valid(false) {};
+
+    // Accessors
+    const unsigned char* data() const { return _data; };
+    size_t size() const { return _size; };
+    bool valid() const { return _valid; };
+};
+
+// Maps the archive into memory (returns false & leaves the loose files in use if it can't)
+bool mountArchive(const std::string& path);
+void unmountArchive();      // every AssetData viewing the archive must be gone
+bool archiveMounted();
+
+AssetData readAsset(const std::string& path);
+bool assetExists(const std::string& path);
+
+// Size & modification time of the original file (for caches derived from an asset)
+bool assetStamp(const std::string& path, int64_t& size, int64_t& mtime);
+
+// Prints how many assets were read, from where & the time spent reading them
+void reportAssetIO();
+
+// Lets Assimp open a model's files (.obj, .mtl, ...) through readAsset
+class AssetIOSystem : public Assimp::IOSystem {
+    std::vector<std::string> _opened;
+
+public:
+    bool Exists(const char*) const override;
+    char getOsSeparator() const override        { return '/'; };
+    Assimp::IOStream* Open(const char*, const char* = "rb") override;
+    void Close(Assimp::IOStream*) override;
+
+    // Every file the importer read
+    const std::vector<std::string>& opened() const { return _opened; };
+};
+
+#endif //OPENGL_ASSETS_H
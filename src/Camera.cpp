@@ -8,7 +8,7 @@ using namespace glm;
 
 Camera::Camera(double xpos, double ypos, Scene* s) : _scene(s),
         _position(vec3(0.0f, HEIGHT, 3.0f)),  _facing(vec3(0.0f, 0.0f, -1.0f)), _up(vec3(0.0f, 1.0f, 0.0f)),
-        _zoom(45.0f), _jumpTime(-1.0f),
+        _zoom(45.0f), _jumpTime(-1.0f), _moves(0),
         _yaw(-90.0f), _pitch(0.0f),
         _xpos(xpos), _ypos(ypos), _mouseSensitivity(MOUSE_SENSITIVITY) {
 
@@ -19,10 +19,11 @@ Camera::Camera(double xpos, double ypos, Scene* s) : _scene(s),
         if (DEBUG) std::cerr << "Warning: camera initialized without a terrain.\n";
         _position.y = HEIGHT;
     }
+    _previousPosition = _renderPosition = _position;
 }
 
 mat4 Camera::ViewMatrix() {
-    return lookAt(_position, _position + _facing, _up);
+    return lookAt(_renderPosition, _renderPosition + _facing, _up);
 }
 
 mat4 Camera::ProjMatrix() {
@@ -34,7 +35,11 @@ mat4 Camera::ProjMatrix() {
 }
 
 vec3 Camera::Position() {
-    return _position;
+    return _renderPosition;
+}
+
+float Camera::FieldOfView() {
+    return radians(_zoom);
 }
 
 void Camera::Look(double xpos, double ypos) {
@@ -111,7 +116,11 @@ float Camera::CalculateSpeed(Direction d) {
 }
 
 void Camera::Move(Direction d) {
-    float speed = CalculateSpeed(d);
+    _moves |= 1 << d;
+}
+
+void Camera::ApplyMove(Direction d, float dt) {
+    float speed = CalculateSpeed(d) * dt;
 
     switch(d) {
         case FORWARD:
@@ -149,8 +158,14 @@ void Camera::Jump() {
     if (_jumpTime == -1) _jumpTime = 0;
 }
 
-// This fcn gets called approximately once every 0.016 seconds (1/60 FPS)
-void Camera::Tick() {
+void Camera::Step(float dt) {
+    _previousPosition = _position;
+
+    // Movement keys are polled once per step
+    for (Direction d : { FORWARD, BACKWARD, LEFT, RIGHT })
+        if (_moves & (1 << d)) ApplyMove(d, dt);
+    _moves = 0;
+
     if (_jumpTime == -1) return;  // don't do anything if we're not jumping
 
     float terrainH = 0;
@@ -162,10 +177,14 @@ void Camera::Tick() {
 
     float jumpH = 3.0f * _jumpTime + 0.5f * -9.8f * _jumpTime * _jumpTime;
     _position.y = terrainH + jumpH + HEIGHT;
-    _jumpTime += 0.016;
+    _jumpTime += dt;
 
     if (jumpH < 0) {     // jump is finished
         _position.y = terrainH + HEIGHT;
         _jumpTime = -1;
     }
 }
+
+void Camera::Interpolate(float alpha) {
+    _renderPosition = mix(_previousPosition, _position, alpha);
+}
@@ -13,20 +13,23 @@ class Camera {
     const float SCREEN_W = 600.0f;
     const float HEIGHT = 0.8f;
     const float MOUSE_SENSITIVITY = 0.15f;
-    const float MOVEMENT_SPEED = 0.03f;
+    const float MOVEMENT_SPEED = 1.8f;      // per second
     /*****************************************/
 
     // Pointer to the scene (used for loading the current terrain)
     Scene* _scene;
 
     // Camera position & orientation
-    glm::vec3 _position;   // Camera position
+    glm::vec3 _position;   // Camera position (as of the last simulation step)
+    glm::vec3 _previousPosition;    // as of the step before, ...
+    glm::vec3 _renderPosition;      // ...& between the two, where the frame is drawn from
     glm::vec3 _facing;     // Direction camera is facing (default = -Z)
     glm::vec3 _up;         // World "up" direction (Y axis)
 
     // Camera state
     float _zoom;
     GLfloat _jumpTime;
+    unsigned int _moves;    // directions requested since the last step (1 << Direction)
 
     // Euler angles
     GLfloat _yaw;          // Rotation to the left or right
@@ -39,6 +42,7 @@ class Camera {
 
     // Determine movement speed based on angle btwn terrain normal & y axis
     float CalculateSpeed(Direction);
+    void ApplyMove(Direction, float);
 
 public:
     Camera(double, double, Scene*);
@@ -47,17 +51,21 @@ public:
     glm::mat4 ViewMatrix();
     glm::mat4 ProjMatrix();
     glm::vec3 Position();
+    float FieldOfView();    // vertical, in radians
+    float ScreenHeight() { return SCREEN_H; };
 
     // Modifiers
     void Look(double, double);
-    void Move(Direction);
+    void Move(Direction);   // during the next step
     void Zoom(float);
 
     // Temporary actions
     void Jump();
 
-    // Timer update
-    void Tick();
+    // Simulation: advances the movement & jump by one fixed step of dt seconds
+    void Step(float dt);
+    // Rendering: places the camera alpha (0-1) of the way from the previous step to the last one
+    void Interpolate(float alpha);
 };
 
 #endif
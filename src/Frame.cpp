@@ -0,0 +1,47 @@
+#include "Frame.h"
+
+#include <thread>
+
+using namespace std;
+
+/********* Configurable settings *********/
+static const int SPINS = 64;                // times a waiting side yields before it starts sleeping...
+static const int SLEEP_MICROSECONDS = 100;  // ...& then for this long at a time
+/*****************************************/
+
+// The other side is usually a fraction of a frame away, so spin briefly before giving the core back
+static void backOff(int& attempts) {
+    if (attempts++ < SPINS) this_thread::yield();
+    else this_thread::sleep_for(chrono::microseconds(SLEEP_MICROSECONDS));
+}
+
+// Frame n is built in packet n % 2, which frame n - 2 was drawn from
+FramePacket* FrameExchange::beginFrame() {
+    uint64_t frame = _published.load(memory_order_relaxed) + 1;
+    for (int attempts = 0; _released.load(memory_order_acquire) + 2 < frame; ) {
+        if (_closed) return nullptr;
+        backOff(attempts);
+    }
+    if (_closed) return nullptr;
+
+    FramePacket* packet = &_packets[frame % 2];
+    packet->number = frame;
+    return packet;
+}
+
+void FrameExchange::publish() {
+    _published.fetch_add(1, memory_order_release);
+}
+
+const FramePacket* FrameExchange::acquire() {
+    uint64_t frame = _released.load(memory_order_relaxed) + 1;
+    for (int attempts = 0; _published.load(memory_order_acquire) < frame; ) {
+        if (_closed) return nullptr;
+        backOff(attempts);
+    }
+    return &_packets[frame % 2];
+}
+
+void FrameExchange::release() {
+    _released.fetch_add(1, memory_order_release);
+}
@@ -0,0 +1,60 @@
+#ifndef OPENGL_FRAME_H
+#define OPENGL_FRAME_H
+
+#include "Glad.h"
+#include "Latency.h"
+
+#include <atomic>
+
+// How meshes pick their level of detail
+enum LodPolicy { LOD_FULL_DETAIL, LOD_SCREEN_SIZE, NUM_LOD_POLICIES };
+
+// Everything the render thread needs from the simulation to draw a frame. The simulation thread builds one per
+// frame & the render thread reads only this, so neither touches the other's state (the camera especially)
+struct FramePacket {
+    uint64_t number;
+
+    // Camera, interpolated to the frame
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 cameraPosition;
+    float fieldOfView;      // vertical, in radians
+    float screenHeight;
+
+    double time;            // the scene clock animations run on
+
+    // Settings the keys toggle
+    bool lit;
+    bool depthPrepass;
+    LodPolicy lodPolicy;
+    bool writeTrace;        // export the profiler's last frames before drawing this one
+
+    InputTimes inputs;      // the input events the frame is the first to reflect (while tracking latency)
+};
+
+// Double-buffered handoff of the packets from the simulation thread to the render thread: while frame N is drawn
+// from one packet, frame N + 1 is built in the other. It's lock-free (each side only advances its own counter),
+// & the simulation can't get more than one frame ahead, so the latency it adds is bounded to a frame
+class FrameExchange {
+    FramePacket _packets[2];
+    std::atomic<uint64_t> _published;   // frames handed to the render thread
+    std::atomic<uint64_t> _released;    // frames it has finished drawing
+    std::atomic<bool> _closed;
+
+public:
+    FrameExchange() : _published(0), _released(0), _closed(false) {};
+
+    // Simulation thread: waits until the packet for the next frame is free (nullptr once closed), fills it in
+    // & publishes it
+    FramePacket* beginFrame();
+    void publish();
+
+    // Render thread: waits for the next packet (nullptr once closed), draws it & releases it
+    const FramePacket* acquire();
+    void release();
+
+    // Wakes up & stops both sides
+    void close() { _closed = true; };
+};
+
+#endif //OPENGL_FRAME_H
@@ -0,0 +1,178 @@
+#include "GpuProfiler.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+/********* Configurable settings *********/
+static const uint64_t GPU_FRAMES = 4;            // query pools, so results are read this many frames later
+static const int MAX_ZONES = 512;                // per frame (the rest aren't measured)
+static const int MAX_NAMES = 64;                 // zone names with totals (the rest are only in the traces)
+static const uint64_t CALIBRATION_FRAMES = 600;  // between lining the GPU's clock up with the profiler's again
+/*****************************************/
+
+// A frame's queries: the start & end of each zone
+struct QueryPool {
+    GLuint queries[2 * MAX_ZONES];
+    const char* names[MAX_ZONES];
+    bool ended[MAX_ZONES];      // a zone whose scope threw has no end
+    int zones;
+    uint64_t frame;
+    bool pending;               // its results haven't been collected
+};
+
+static QueryPool pools[GPU_FRAMES];
+static QueryPool* current = nullptr;
+static uint64_t frame = 0;
+static bool initialized = false;
+static bool supported = false;
+static ProfileTrack* track = nullptr;
+
+// The GPU's clock (nanoseconds) & the profiler's (ticks) at the same moment
+static GLint64 gpuReference = 0;
+static uint64_t cpuReference = 0;
+
+// Since the last report
+struct Total {
+    const char* name;
+    double milliseconds;
+    uint64_t frames;            // that had the zone (ie the depth pre-pass can be off)
+    uint64_t lastFrame;
+};
+static Total totals[MAX_NAMES];
+static int numTotals = 0;
+static uint64_t framesCollected = 0;
+static uint64_t framesDropped = 0;
+static uint64_t zonesDropped = 0;
+
+static void initialize() {
+    initialized = true;
+
+    // The number of bits may be 0, in which case the driver has no timestamps (GL only requires the query type)
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    supported = (bits > 0);
+    if (!supported) {
+        cerr << "Warning: the driver has no GPU timestamps, GPU zones are off" << endl;
+        return;
+    }
+
+    for (auto& it : pools) {
+        glGenQueries(2 * MAX_ZONES, it.queries);
+        it.zones = 0;
+        it.pending = false;
+    }
+    track = profileTrack("GPU");
+}
+
+static void calibrate() {
+    glGetInteger64v(GL_TIMESTAMP, &gpuReference);
+    cpuReference = profileTicks();
+}
+
+static uint64_t toTicks(GLuint64 time, double ticksPerNanosecond) {
+    double ticks = cpuReference + ((GLint64) time - gpuReference) * ticksPerNanosecond;
+    return (ticks > 0) ? (uint64_t) ticks : 0;
+}
+
+// The name's total, which is first looked up by address since the names are mostly the same literals each frame
+static Total* findTotal(const char* name, bool add) {
+    for (int i = 0; i < numTotals; i++)
+        if (totals[i].name == name) return &totals[i];
+    for (int i = 0; i < numTotals; i++)
+        if (strcmp(totals[i].name, name) == 0) return &totals[i];
+
+    if (!add || numTotals == MAX_NAMES) return nullptr;
+    totals[numTotals] = { name, 0.0, 0, UINT64_MAX };
+    return &totals[numTotals++];
+}
+
+// Reads the results if they're all available, & drops the frame otherwise rather than wait for them
+static void collect(QueryPool& pool) {
+    pool.pending = false;
+    for (int i = 0; i < pool.zones; i++) {
+        if (!pool.ended[i]) continue;
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(pool.queries[2 * i + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            framesDropped++;
+            return;
+        }
+    }
+
+    double ticksPerNanosecond = profileTickRate() / 1000.0;
+    for (int i = 0; i < pool.zones; i++) {
+        if (!pool.ended[i]) continue;
+        GLuint64 start, end;
+        glGetQueryObjectui64v(pool.queries[2 * i], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(pool.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+        if (end < start) continue;
+
+        recordZone(track, pool.names[i], toTicks(start, ticksPerNanosecond), toTicks(end, ticksPerNanosecond));
+        Total* total = findTotal(pool.names[i], true);
+        if (!total) continue;
+        total->milliseconds += (end - start) / 1e6;
+        if (total->lastFrame != pool.frame) total->frames++;
+        total->lastFrame = pool.frame;
+    }
+    framesCollected++;
+}
+
+void beginGpuFrame() {
+    if (!initialized) initialize();
+    if (!supported) return;
+
+    if (frame % CALIBRATION_FRAMES == 0) calibrate();
+    current = &pools[frame % GPU_FRAMES];
+    if (current->pending) collect(*current);
+    current->zones = 0;
+    current->frame = frame;
+    current->pending = true;
+    frame++;
+}
+
+int beginGpuZone(const char* name) {
+    if (current == nullptr) return -1;
+    if (current->zones == MAX_ZONES) {
+        zonesDropped++;
+        return -1;
+    }
+
+    int zone = current->zones++;
+    current->names[zone] = name;
+    current->ended[zone] = false;
+    glQueryCounter(current->queries[2 * zone], GL_TIMESTAMP);
+    return zone;
+}
+
+void endGpuZone(int zone) {
+    if (zone < 0 || current == nullptr) return;
+    glQueryCounter(current->queries[2 * zone + 1], GL_TIMESTAMP);
+    current->ended[zone] = true;
+}
+
+void reportGpuZones() {
+    if (!supported || framesCollected == 0) return;
+
+    cout << "GPU time per frame over " << framesCollected << " frames (" << framesDropped << " dropped, "
+         << zonesDropped << " zones over the limit):" << endl;
+    for (int i = 0; i < numTotals; i++) {
+        if (totals[i].frames == 0) continue;
+        cout << "  " << totals[i].name << ": " << totals[i].milliseconds / totals[i].frames << "ms";
+        if (totals[i].frames != framesCollected) cout << " (in " << totals[i].frames << " frames)";
+        cout << endl;
+        totals[i].milliseconds = 0;
+        totals[i].frames = 0;
+    }
+    framesCollected = framesDropped = zonesDropped = 0;
+}
+
+void deleteGpuQueries() {
+    if (supported) {
+        for (auto& it : pools)
+            glDeleteQueries(2 * MAX_ZONES, it.queries);
+    }
+    current = nullptr;
+    initialized = supported = false;
+}
@@ -0,0 +1,41 @@
+#ifndef OPENGL_GPUPROFILER_H
+#define OPENGL_GPUPROFILER_H
+
+#include "Glad.h"
+#include "Profiler.h"
+
+// GPU time of the draws between the start & end of a zone, from a GL_TIMESTAMP query at each end (unlike
+// GL_TIME_ELAPSED queries, those can nest: a model's zone inside its pass's). Each frame in flight has its own pool
+// of queries, & a frame's results are only read GPU_FRAMES frames later, once they're available, so reading them
+// never stalls: a frame whose results still aren't in by then is dropped instead.
+// The zones go to the profiler's "GPU" track (so they're in its traces, see Profiler.h) converted to its clock,
+// & their totals by name to reportGpuZones. Everything here is render thread only
+
+// The start of a frame: collects the results of the frame that last used this frame's pool
+void beginGpuFrame();
+
+// Records a query at the start & end of a zone (no-ops if the driver has no timestamps or the pool is full)
+int beginGpuZone(const char* name);     // the name has to outlive the profiler (see profileName)
+void endGpuZone(int zone);
+
+// Prints the average GPU time of each zone name per frame that had it, & starts over
+void reportGpuZones();
+
+// Deletes the query pools (with the context current)
+void deleteGpuQueries();
+
+// Times the enclosing scope's draws
+struct GpuZone {
+    int zone;
+
+    explicit GpuZone(const char* name) : zone(beginGpuZone(name)) {};
+    ~GpuZone() { endGpuZone(zone); };
+};
+
+#if PROFILER
+#define PROFILE_GPU_ZONE(name) GpuZone PROFILE_CONCAT(gpuZone, __LINE__)(name)
+#else
+#define PROFILE_GPU_ZONE(name)
+#endif
+
+#endif //OPENGL_GPUPROFILER_H
@@ -0,0 +1,198 @@
+#include "Jobs.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+// Which queue of which system the current thread owns (non-workers use queue 0)
+static thread_local JobSystem* currentSystem = nullptr;
+static thread_local int currentQueue = 0;
+
+JobSystem::JobSystem(int threads) : _queued(0), _started(0), _quit(false) {
+    threads = max(1, min(threads, MAX_THREADS));
+    for (int i = 0; i < threads; i++)
+        _queues.emplace_back(new Queue());
+    for (int i = 1; i < threads; i++)
+        _workers.emplace_back(&JobSystem::workerLoop, this, i);
+
+    // So that their setup is over before the frames start
+    while (_started.load() < (int) _workers.size())
+        this_thread::yield();
+}
+
+JobSystem::~JobSystem() {
+    {
+        lock_guard<mutex> guard(_sleepLock);
+        _quit = true;
+    }
+    _wake.notify_all();
+    for (auto& it : _workers)
+        it.join();
+}
+
+JobSystem& JobSystem::get() {
+    static JobSystem instance(max(1u, thread::hardware_concurrency()));
+    return instance;
+}
+
+// Doubles the ring (unrolled to start at 0) when it's full
+void JobSystem::Queue::pushBack(Job&& job) {
+    if (count == jobs.size()) {
+        vector<Job> grown(max((size_t) 16, jobs.size() * 2));
+        for (size_t i = 0; i < count; i++)
+            grown[i] = std::move(jobs[(first + i) % jobs.size()]);
+        jobs.swap(grown);
+        first = 0;
+    }
+    jobs[(first + count) % jobs.size()] = std::move(job);
+    count++;
+}
+
+Job JobSystem::Queue::popBack() {
+    count--;
+    return std::move(jobs[(first + count) % jobs.size()]);
+}
+
+Job JobSystem::Queue::popFront() {
+    Job job = std::move(jobs[first]);
+    first = (first + 1) % jobs.size();
+    count--;
+    return job;
+}
+
+void JobSystem::push(Job&& job) {
+    int index = (currentSystem == this) ? currentQueue : 0;
+    {
+        lock_guard<mutex> guard(_queues[index]->lock);
+        _queues[index]->pushBack(std::move(job));
+    }
+    {
+        // Under the lock, so that a worker can't miss the wake up between checking _queued & sleeping
+        lock_guard<mutex> guard(_sleepLock);
+        _queued++;
+    }
+    _wake.notify_one();
+}
+
+bool JobSystem::pop(Job& job) {
+    int self = (currentSystem == this) ? currentQueue : 0;
+
+    // Newest first from our own queue...
+    {
+        Queue& own = *_queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (own.count > 0) {
+            job = own.popBack();
+            _queued--;
+            return true;
+        }
+    }
+
+    // ...then oldest first from the others
+    for (size_t i = 1; i < _queues.size(); i++) {
+        Queue& victim = *_queues[(self + i) % _queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (victim.count > 0) {
+            job = victim.popFront();
+            _queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Job& job) {
+    try {
+        if (job.body) (*job.body)(job.begin, job.end);
+        else job.work();
+    } catch (...) {
+        lock_guard<mutex> guard(_errorLock);
+        if (!_error) _error = current_exception();
+    }
+
+    JobCounter* counter = job.counter;
+    if (counter == nullptr) return;
+
+    // If that was the counter's last job, queue the jobs that were waiting for it. The counter isn't touched
+    // after the lock is released, since the thread waiting for it can then return & destroy it
+    lock_guard<mutex> guard(counter->_lock);
+    if (--counter->_pending > 0) return;
+    for (auto& it : counter->_continuations)
+        push(std::move(it));
+    counter->_continuations.clear();
+}
+
+void JobSystem::workerLoop(int index) {
+    currentSystem = this;
+    currentQueue = index;
+    PROFILE_THREAD(("Worker " + to_string(index)).c_str());
+    _started++;
+
+    Job job;
+    while (true) {
+        if (pop(job)) {
+            execute(job);
+            continue;
+        }
+
+        unique_lock<mutex> guard(_sleepLock);
+        _wake.wait(guard, [this] { return _quit || _queued > 0; });
+        if (_quit) return;
+    }
+}
+
+void JobSystem::run(function<void()> work, JobCounter* counter) {
+    if (counter) counter->_pending++;
+    push({ std::move(work), nullptr, 0, 0, counter });
+}
+
+void JobSystem::runAfter(JobCounter& dependency, function<void()> work, JobCounter* counter) {
+    if (counter) counter->_pending++;
+
+    {
+        // The dependency's last job takes the same lock before it starts the continuations
+        lock_guard<mutex> guard(dependency._lock);
+        if (dependency._pending > 0) {
+            dependency._continuations.push_back({ std::move(work), nullptr, 0, 0, counter });
+            return;
+        }
+    }
+    push({ std::move(work), nullptr, 0, 0, counter });
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    Job job;
+    while (counter._pending > 0) {
+        if (pop(job)) execute(job);
+        else this_thread::yield();  // the last jobs are running on other threads
+    }
+    { lock_guard<mutex> guard(counter._lock); }     // until the last job is done with the counter
+
+    lock_guard<mutex> guard(_errorLock);
+    if (_error) {
+        exception_ptr error = _error;
+        _error = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+// The chunks all point at the counter's copy of the body, rather than each capturing one
+void JobSystem::parallelFor(size_t count, size_t chunkSize, const function<void(size_t, size_t)>& body, JobCounter& counter) {
+    if (counter._pending > 0) throw runtime_error("parallelFor given a counter that's still in use");
+    counter._body = body;
+
+    if (chunkSize == 0) chunkSize = max((size_t) 1, count / (threads() * CHUNKS_PER_THREAD));
+    for (size_t begin = 0; begin < count; begin += chunkSize) {
+        size_t end = min(begin + chunkSize, count);
+        counter._pending++;
+        push({ nullptr, &counter._body, begin, end, &counter });
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t chunkSize, const function<void(size_t, size_t)>& body) {
+    JobCounter counter;
+    parallelFor(count, chunkSize, body, counter);
+    wait(counter);
+}
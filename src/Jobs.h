@@ -0,0 +1,113 @@
+#ifndef OPENGL_JOBS_H
+#define OPENGL_JOBS_H
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+// A queued piece of work: either a function, or a chunk of a parallelFor's range
+struct Job {
+    std::function<void()> work;
+    const std::function<void(size_t, size_t)>* body;
+    size_t begin, end;
+    JobCounter* counter;
+};
+
+// Counts the jobs started with it that haven't finished yet. Jobs can also be made to wait for a counter
+// (see JobSystem::runAfter), which is how the frame's jobs depend on each other
+class JobCounter {
+    friend class JobSystem;
+
+    std::atomic<int> _pending;
+    std::mutex _lock;
+    std::vector<Job> _continuations;    // queued once _pending reaches 0 (the vector keeps its capacity)
+    std::function<void(size_t, size_t)> _body;      // of the parallelFor running with the counter
+
+public:
+    // Room for the continuations up front, for a counter that's used every frame (whether a continuation has to
+    // wait for it depends on the timing, so the vector could otherwise grow on any frame)
+    explicit JobCounter(size_t continuations = 0) : _pending(0) { _continuations.reserve(continuations); };
+    bool done() { return _pending.load() == 0; };
+};
+
+// Work stealing thread pool for the CPU side of a frame. Every thread has a deque of jobs: a thread works on the
+// newest job of its own deque (the one whose data is most likely still in cache), & once it runs out it steals
+// the oldest job of another's (the biggest piece of work left). The thread that waits for a counter runs jobs
+// until it reaches 0, so waiting never blocks & jobs can start (& wait for) jobs of their own.
+// Jobs mustn't make GL calls: only the thread with the context can.
+// Once the queues have grown to the most jobs they've held, running jobs doesn't allocate (the functions passed
+// in have to be small enough for std::function to store inline, like a lambda capturing this)
+class JobSystem {
+    /********* Configurable settings *********/
+    const int MAX_THREADS = 16;
+    const int CHUNKS_PER_THREAD = 4;    // parallelFor's default chunking, so that threads that finish early can steal
+    static const size_t QUEUE_CAPACITY = 256;   // jobs a queue has room for up front: more than a frame queues at once
+                                                // (whether a queue fills up depends on how fast it drains, so it could
+                                                // otherwise grow on any frame)
+    /*****************************************/
+
+    // A ring buffer of jobs
+    struct Queue {
+        std::mutex lock;
+        std::vector<Job> jobs;
+        size_t first;
+        size_t count;
+
+        Queue() : jobs(QUEUE_CAPACITY), first(0), count(0) {};
+        void pushBack(Job&&);
+        Job popBack();
+        Job popFront();
+    };
+
+    // Queue 0 belongs to the threads that aren't workers (ie the main thread)
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _workers;
+
+    std::atomic<int> _queued;
+    std::atomic<int> _started;      // workers that have set up (which allocates)
+    std::atomic<bool> _quit;
+    std::mutex _sleepLock;
+    std::condition_variable _wake;
+
+    // The first exception a job threw, rethrown by wait()
+    std::mutex _errorLock;
+    std::exception_ptr _error;
+
+    void push(Job&&);
+    bool pop(Job&);
+    void execute(Job&);
+    void workerLoop(int);
+
+public:
+    explicit JobSystem(int threads);    // including the calling thread
+    ~JobSystem();
+
+    // Shared by the scene, with a thread per core
+    static JobSystem& get();
+
+    int threads() { return (int) _workers.size() + 1; };
+
+    // Queues a job, which decrements the counter (if given) once it's done
+    void run(std::function<void()>, JobCounter* = nullptr);
+
+    // Queues a job once every job of the dependency has finished
+    void runAfter(JobCounter& dependency, std::function<void()>, JobCounter* = nullptr);
+
+    // Runs jobs until the counter reaches 0 - can throw the exception of a failed job
+    void wait(JobCounter&);
+
+    // Calls body(begin, end) over [0, count) in chunks of up to chunkSize (0 picks the size from the thread count).
+    // The first version returns once the chunks are queued (the counter keeps a copy of the body, so it can't be
+    // used by another parallelFor until they're done), the second once they're done
+    void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& body, JobCounter&);
+    void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& body);
+};
+
+#endif //OPENGL_JOBS_H
@@ -0,0 +1,137 @@
+#include "Latency.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+
+using namespace std;
+
+typedef chrono::high_resolution_clock Clock;
+
+/********* Configurable settings *********/
+static const size_t REPORT_EVENTS = 1000;          // latencies are printed each time this many events are measured
+static const GLuint64 WAIT_TIMEOUT = 100000000;    // nanoseconds per fence wait, before checking again
+static const size_t RESERVED_FRAMES = 8;           // more than the render thread lets queue up (see main.cpp)
+/*****************************************/
+
+// A swapped frame the GPU may not have finished yet, & the input events it's the first to reflect
+struct Frame {
+    GLsync fence;
+    Clock::time_point swapped;
+    InputTimes inputs;
+};
+
+// Render thread only, oldest first (reserved, so frames don't allocate)
+static vector<Frame> frames = [] {
+    vector<Frame> reserved;
+    reserved.reserve(RESERVED_FRAMES);
+    return reserved;
+}();
+static InputTimes pendingInputs;    // main thread only
+
+// Toggled from the main thread, measured on the render thread
+static atomic<bool> tracking(false);
+static mutex statsLock;
+static vector<double> toSwap, toCompletion;     // milliseconds, per event
+
+static double milliseconds(Clock::duration d) {
+    return chrono::duration<double, milli>(d).count();
+}
+
+static void retire(Frame& frame, Clock::time_point completed) {
+    glDeleteSync(frame.fence);
+    if (!tracking || frame.inputs.empty()) return;
+
+    {
+        lock_guard<mutex> guard(statsLock);
+        for (auto& input : frame.inputs) {
+            toSwap.push_back(milliseconds(frame.swapped - input));
+            toCompletion.push_back(milliseconds(completed - input));
+        }
+        if (toSwap.size() < REPORT_EVENTS) return;
+    }
+    reportLatency();
+}
+
+// Retires the frames that have finished, without waiting. A fence found already signaled could have signaled
+// any time since the last check, so those completion times are upper bounds (the main loop checks every frame)
+static void retireFinished() {
+    while (!frames.empty()) {
+        GLenum result = glClientWaitSync(frames.front().fence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED) break;
+
+        retire(frames.front(), Clock::now());
+        frames.erase(frames.begin());
+    }
+}
+
+void waitForFrames(int maxQueued) {
+    retireFinished();
+    while (frames.size() > (size_t) maxQueued) {
+        // Flushing, in case the fence is still only in the driver's command buffer
+        GLenum result = glClientWaitSync(frames.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT);
+        if (result == GL_TIMEOUT_EXPIRED) continue;
+
+        retire(frames.front(), Clock::now());
+        frames.erase(frames.begin());
+    }
+}
+
+void inputEvent() {
+    if (tracking) pendingInputs.push_back(Clock::now());
+}
+
+InputTimes takeInputEvents() {
+    InputTimes inputs;
+    inputs.swap(pendingInputs);
+    return inputs;
+}
+
+void frameSwapped(InputTimes&& inputs) {
+    Frame frame = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), Clock::now(), std::move(inputs) };
+    frames.push_back(std::move(frame));
+}
+
+bool latencyTracking() {
+    return tracking;
+}
+
+void toggleLatencyTracking() {
+    if (tracking) {
+        reportLatency();
+        tracking = false;
+    } else {
+        lock_guard<mutex> guard(statsLock);
+        pendingInputs.clear();
+        toSwap.clear();
+        toCompletion.clear();
+        tracking = true;
+    }
+    cout << "Latency tracking turned " << (tracking ? "on" : "off") << endl;
+}
+
+// Nearest rank
+static double percentile(const vector<double>& sorted, double p) {
+    size_t rank = (size_t) ceil(p / 100.0 * sorted.size());
+    return sorted[min(max(rank, (size_t) 1), sorted.size()) - 1];
+}
+
+static void printPercentiles(const char* label, vector<double>& samples) {
+    sort(samples.begin(), samples.end());
+    cout << "  " << label << ": p50 " << percentile(samples, 50) << "ms, p90 " << percentile(samples, 90)
+         << "ms, p99 " << percentile(samples, 99) << "ms, max " << samples.back() << "ms" << endl;
+}
+
+void reportLatency() {
+    lock_guard<mutex> guard(statsLock);
+    if (toSwap.empty()) return;
+
+    cout << "Input latency over " << toSwap.size() << " events:" << endl;
+    printPercentiles("to swap", toSwap);
+    printPercentiles("to GPU completion", toCompletion);
+    toSwap.clear();
+    toCompletion.clear();
+}
@@ -0,0 +1,33 @@
+#ifndef OPENGL_LATENCY_H
+#define OPENGL_LATENCY_H
+
+#include "Glad.h"
+
+#include <chrono>
+#include <vector>
+
+// Frame pacing & input-to-photon latency measurement.
+// Every frame is followed by a fence, & the render thread waits on the fence of an earlier frame before it takes
+// the next one, so the driver can't queue up frames (each of them showing older input).
+// While tracking is on, each input event is timestamped when it arrives, attached to the frame drawn after it &
+// measured to the frame's swap & to when its fence signals (the GPU has finished it - the photons follow at scanout)
+
+typedef std::vector<std::chrono::high_resolution_clock::time_point> InputTimes;
+
+// Render thread: waits until no more than this many frames are queued on the GPU
+void waitForFrames(int maxQueued);
+
+// Main thread: an input event arrived (called from the GLFW callbacks)...
+void inputEvent();
+// ...& the events since the last call, for the frame that's about to be built from them
+InputTimes takeInputEvents();
+
+// Render thread: the frame reflecting these events was just swapped
+void frameSwapped(InputTimes&&);
+
+// Starts tracking, or stops & prints the latency percentiles
+void toggleLatencyTracking();
+bool latencyTracking();     // (which allocates for the events' timestamps)
+void reportLatency();
+
+#endif //OPENGL_LATENCY_H
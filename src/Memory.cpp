@@ -0,0 +1,35 @@
+#include "Memory.h"
+
+#include <sys/resource.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#elif defined(__linux__)
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+size_t residentMemory() {
+#if defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) != KERN_SUCCESS) return 0;
+    return info.resident_size;
+#elif defined(__linux__)
+    // Second field of statm is the resident page count
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) return 0;
+    long pages = 0, resident = 0;
+    int read = fscanf(statm, "%ld %ld", &pages, &resident);
+    fclose(statm);
+    return (read == 2) ? size_t(resident) * sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+size_t majorPageFaults() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return usage.ru_majflt;
+}
@@ -0,0 +1,12 @@
+#ifndef OPENGL_MEMORY_H
+#define OPENGL_MEMORY_H
+
+#include <cstddef>
+
+// Resident set size of the process in bytes (0 if it can't be queried on this platform)
+size_t residentMemory();
+
+// Page faults that had to wait for the disk so far, ie reads of a mapped file that weren't already cached
+size_t majorPageFaults();
+
+#endif //OPENGL_MEMORY_H
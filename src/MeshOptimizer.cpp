@@ -0,0 +1,346 @@
+#include "MeshOptimizer.h"
+#include "Objects/Object.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/*************************************************************
+                          Analysis
+ *************************************************************/
+
+VertexCacheStats analyzeVertexCache(const vector<unsigned int>& indices, size_t vertexCount, int cacheSize) {
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if (indices.empty() || vertexCount == 0) return stats;
+
+    // Timestamps make the FIFO check O(1): a vertex is cached if it was inserted less than cacheSize misses ago
+    vector<unsigned int> insertedAt(vertexCount, 0);
+    unsigned int misses = 0;
+    for (auto v : indices) {
+        if (insertedAt[v] == 0 || misses - insertedAt[v] + 1 > (unsigned int) cacheSize) {
+            misses++;
+            insertedAt[v] = misses;
+        }
+    }
+
+    size_t used = 0;
+    for (auto t : insertedAt)
+        if (t) used++;
+
+    stats.acmr = float(misses) / (indices.size() / 3);
+    stats.atvr = float(misses) / used;
+    return stats;
+}
+
+/*************************************************************
+                       Vertex cache
+ *************************************************************/
+
+// Triangle adjacency in CSR form: triangles using vertex v are adjacency[offsets[v] .. offsets[v+1])
+struct Adjacency {
+    vector<unsigned int> offsets;
+    vector<unsigned int> triangles;
+};
+
+static Adjacency buildAdjacency(const vector<unsigned int>& indices, size_t vertexCount) {
+    Adjacency adj;
+    adj.offsets.assign(vertexCount + 1, 0);
+    for (auto v : indices) adj.offsets[v + 1]++;
+    for (size_t v = 0; v < vertexCount; v++) adj.offsets[v + 1] += adj.offsets[v];
+
+    adj.triangles.resize(indices.size());
+    vector<unsigned int> fill(adj.offsets.begin(), adj.offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adj.triangles[fill[indices[i]]++] = i / 3;
+    return adj;
+}
+
+vector<unsigned int> optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount, int cacheSize) {
+    vector<unsigned int> clusters;
+    size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0) return clusters;
+
+    Adjacency adj = buildAdjacency(indices, vertexCount);
+
+    vector<int> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        liveTriangles[v] = adj.offsets[v + 1] - adj.offsets[v];
+
+    vector<unsigned int> cacheTime(vertexCount, 0);
+    vector<bool> emitted(numTriangles, false);
+    vector<unsigned int> deadEnd;
+    vector<unsigned int> candidates;
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+
+    unsigned int timestamp = cacheSize + 1;
+    size_t cursor = 0;
+    long fanning = indices[0];
+    clusters.push_back(0);
+
+    while (fanning >= 0) {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = adj.offsets[fanning]; a < adj.offsets[fanning + 1]; a++) {
+            unsigned int t = adj.triangles[a];
+            if (emitted[t]) continue;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (timestamp - cacheTime[v] > (unsigned int) cacheSize)
+                    cacheTime[v] = timestamp++;
+            }
+            emitted[t] = true;
+        }
+
+        // Pick the next fanning vertex: the candidate that's still in the cache & will stay there the longest
+        long next = -1;
+        int best = -1;
+        for (auto v : candidates) {
+            if (liveTriangles[v] <= 0) continue;
+            int priority = 0;
+            if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= (unsigned int) cacheSize)
+                priority = timestamp - cacheTime[v];
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+
+        // Dead end: backtrack through recently used vertices, then fall back to scanning for any live vertex.
+        // The cache is effectively cold after this, so it's a hard boundary for the overdraw clusters
+        if (next == -1) {
+            while (!deadEnd.empty() && next == -1) {
+                unsigned int d = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[d] > 0) next = d;
+            }
+            while (next == -1 && cursor < vertexCount) {
+                if (liveTriangles[cursor] > 0) next = cursor;
+                cursor++;
+            }
+            if (next != -1 && result.size() / 3 < numTriangles) clusters.push_back(result.size() / 3);
+        }
+        fanning = next;
+    }
+
+    indices.swap(result);
+    return clusters;
+}
+
+/*************************************************************
+                          Overdraw
+ *************************************************************/
+
+// Splits the hard clusters wherever the cache efficiency so far is within threshold of the whole cluster's
+static vector<unsigned int> softBoundaries(const vector<unsigned int>& indices, const vector<unsigned int>& clusters,
+                                           size_t vertexCount, float threshold) {
+    const int cacheSize = 16;
+    vector<unsigned int> result;
+    vector<unsigned int> insertedAt(vertexCount, 0);
+    unsigned int time = 0;
+
+    auto missesFor = [&](unsigned int triangle) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[triangle * 3 + k];
+            if (insertedAt[v] == 0 || time - insertedAt[v] + 1 > (unsigned int) cacheSize) {
+                insertedAt[v] = ++time;
+                misses++;
+            }
+        }
+        return misses;
+    };
+
+    size_t numTriangles = indices.size() / 3;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        unsigned int start = clusters[c];
+        unsigned int end = (c + 1 < clusters.size()) ? clusters[c + 1] : numTriangles;
+
+        // Total ACMR for the cluster (starting with a cold cache)
+        time += cacheSize + 1;
+        int clusterMisses = 0;
+        for (unsigned int t = start; t < end; t++) clusterMisses += missesFor(t);
+        float clusterACMR = float(clusterMisses) / (end - start);
+
+        time += cacheSize + 1;
+        result.push_back(start);
+        int misses = 0;
+        unsigned int runStart = start;
+        for (unsigned int t = start; t < end; t++) {
+            misses += missesFor(t);
+            if (t + 1 < end && float(misses) / (t + 1 - runStart) <= clusterACMR * threshold) {
+                result.push_back(t + 1);
+                runStart = t + 1;
+                misses = 0;
+                time += cacheSize + 1;
+            }
+        }
+    }
+    return result;
+}
+
+void optimizeOverdraw(vector<unsigned int>& indices, const vector<unsigned int>& hardClusters,
+                      const float* positions, size_t stride, size_t vertexCount, float threshold) {
+    size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0 || hardClusters.empty()) return;
+
+    vector<unsigned int> clusters = softBoundaries(indices, hardClusters, vertexCount, threshold);
+
+    auto position = [&](unsigned int v) {
+        const float* p = (const float*) ((const char*) positions + v * stride);
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+
+    // Area weighted centroid & normal of each cluster
+    vector<glm::vec3> centroids(clusters.size(), glm::vec3(0.0f));
+    vector<glm::vec3> normals(clusters.size(), glm::vec3(0.0f));
+    vector<float> areas(clusters.size(), 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+        unsigned int end = (c + 1 < clusters.size()) ? clusters[c + 1] : numTriangles;
+        for (unsigned int t = clusters[c]; t < end; t++) {
+            glm::vec3 p0 = position(indices[t * 3]);
+            glm::vec3 p1 = position(indices[t * 3 + 1]);
+            glm::vec3 p2 = position(indices[t * 3 + 2]);
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(n);
+
+            centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            normals[c] += n;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+        if (areas[c] > 0.0f) centroids[c] = centroids[c] / areas[c];
+    }
+    if (meshArea > 0.0f) meshCentroid = meshCentroid / meshArea;
+
+    // Clusters facing away from the middle of the mesh are the likeliest occluders
+    vector<float> sortKey(clusters.size());
+    vector<unsigned int> order(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        float len = glm::length(normals[c]);
+        sortKey[c] = (len > 0.0f) ? glm::dot(centroids[c] - meshCentroid, normals[c] / len) : 0.0f;
+        order[c] = c;
+    }
+    stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (auto c : order) {
+        unsigned int end = (c + 1 < clusters.size()) ? clusters[c + 1] : numTriangles;
+        result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+    }
+    indices.swap(result);
+}
+
+/*************************************************************
+                        Vertex fetch
+ *************************************************************/
+
+vector<unsigned int> optimizeVertexFetch(vector<unsigned int>& indices, size_t vertexCount) {
+    const unsigned int unassigned = ~0u;
+    vector<unsigned int> remap(vertexCount, unassigned);
+
+    unsigned int next = 0;
+    for (auto& v : indices) {
+        if (remap[v] == unassigned) remap[v] = next++;
+        v = remap[v];
+    }
+
+    // Vertices that aren't referenced at all go at the end
+    for (auto& r : remap)
+        if (r == unassigned) r = next++;
+    return remap;
+}
+
+/*************************************************************
+                          Welding
+ *************************************************************/
+
+static size_t hashVertex(const unsigned char* v, size_t stride) {
+#ifdef __SSE2__
+    if (stride % 16 == 0) {
+        // Fold the vertex 16 bytes at a time (acc * 33 ^ next), then mix the four lanes with 32x32->64 multiplies
+        __m128i acc = _mm_loadu_si128((const __m128i*) v);
+        for (size_t i = 16; i < stride; i += 16) {
+            __m128i next = _mm_loadu_si128((const __m128i*)(v + i));
+            acc = _mm_xor_si128(_mm_add_epi32(acc, _mm_slli_epi32(acc, 5)), next);
+        }
+        const __m128i k = _mm_set1_epi32(0x9E3779B1);
+        __m128i lo = _mm_mul_epu32(acc, k);                         // lanes 0 & 2
+        __m128i hi = _mm_mul_epu32(_mm_srli_epi64(acc, 32), k);     // lanes 1 & 3
+        __m128i m = _mm_xor_si128(lo, _mm_slli_epi64(hi, 17));
+        m = _mm_xor_si128(m, _mm_srli_si128(m, 8));
+
+        uint64_t h;
+        _mm_storel_epi64((__m128i*) &h, m);
+        return size_t(h ^ (h >> 29));
+    }
+#endif
+    // FNV-1a
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < stride; i++)
+        h = (h ^ v[i]) * 1099511628211ull;
+    return size_t(h);
+}
+
+size_t weldVertices(vector<unsigned int>& indices, void* vertices, size_t stride, size_t vertexCount) {
+    unsigned char* data = (unsigned char*) vertices;
+
+    // Open addressing table of compacted vertex indices, at most half full
+    const unsigned int empty = ~0u;
+    size_t tableSize = 16;
+    while (tableSize < vertexCount * 2) tableSize *= 2;
+    vector<unsigned int> table(tableSize, empty);
+
+    vector<unsigned int> remap(vertexCount);
+    size_t unique = 0;
+    for (size_t v = 0; v < vertexCount; v++) {
+        const unsigned char* vtx = data + v * stride;
+        size_t slot = hashVertex(vtx, stride) & (tableSize - 1);
+        while (table[slot] != empty && memcmp(data + table[slot] * stride, vtx, stride) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == empty) {
+            // Compacting as we go never overwrites a vertex that's still to be read (unique <= v)
+            if (unique != v) memcpy(data + unique * stride, vtx, stride);
+            table[slot] = unique++;
+        }
+        remap[v] = table[slot];
+    }
+
+    for (auto& i : indices) i = remap[i];
+    return unique;
+}
+
+vector<unsigned int> optimizeMesh(vector<unsigned int>& indices, const float* positions, size_t stride,
+                                  size_t vertexCount, const string& name) {
+    VertexCacheStats before = analyzeVertexCache(indices, vertexCount);
+
+    vector<unsigned int> clusters = optimizeVertexCache(indices, vertexCount);
+    optimizeOverdraw(indices, clusters, positions, stride, vertexCount);
+    vector<unsigned int> remap = optimizeVertexFetch(indices, vertexCount);
+
+    if (DEBUG) {
+        VertexCacheStats after = analyzeVertexCache(indices, vertexCount);
+        cout << fixed << setprecision(3) << "Optimized " << name << " (" << indices.size() / 3 << " triangles): "
+             << "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+             << endl;
+    }
+    return remap;
+}
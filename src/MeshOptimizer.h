@@ -0,0 +1,50 @@
+#ifndef OPENGL_MESHOPTIMIZER_H
+#define OPENGL_MESHOPTIMIZER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Import-time passes that reorder triangle lists for the GPU's post-transform vertex cache,
+// for less overdraw, and for linear vertex fetching. None of them change the rendered result.
+
+struct VertexCacheStats {
+    float acmr;     // average cache miss ratio: transformed vertices per triangle (0.5 is ideal on a grid, 3 is worst)
+    float atvr;     // average transformed vertex ratio: transformed vertices per unique vertex (1 is ideal)
+};
+
+// Simulates a FIFO post-transform cache of the given size
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize = 16);
+
+// Tipsify (Sander et al. 2007): reorders the triangles in place for the vertex cache & returns the
+// index (in triangles) at which each cluster of the new order starts, for optimizeOverdraw
+std::vector<unsigned int> optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize = 16);
+
+// Sorts the clusters so that outward facing ones are drawn first, which lets early-Z reject more of the
+// rest. A threshold > 1 lets clusters be split further at the cost of that much vertex cache efficiency
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<unsigned int>& clusters,
+                      const float* positions, size_t stride, size_t vertexCount, float threshold = 1.05f);
+
+// Renumbers the vertices in the order the index buffer first references them.
+// Returns the remap table (remap[oldIndex] = newIndex) to apply to the vertex data
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount);
+
+// Applies a remap table produced by optimizeVertexFetch to an array of vertices
+template <typename T>
+void remapVertices(std::vector<T>& vertices, const std::vector<unsigned int>& remap) {
+    std::vector<T> result(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+        result[remap[i]] = vertices[i];
+    vertices.swap(result);
+}
+
+// Merges vertices whose bytes are identical (OBJ files duplicate a vertex for every face using it).
+// Unique vertices are compacted to the front of `vertices` in first-use order & the indices rewritten.
+// Returns the number of unique vertices
+size_t weldVertices(std::vector<unsigned int>& indices, void* vertices, size_t stride, size_t vertexCount);
+
+// Runs all three passes & prints the before/after cache statistics (in debug mode)
+std::vector<unsigned int> optimizeMesh(std::vector<unsigned int>& indices, const float* positions, size_t stride,
+                                       size_t vertexCount, const std::string& name);
+
+#endif //OPENGL_MESHOPTIMIZER_H
@@ -0,0 +1,236 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+struct Vec3 {
+    double x, y, z;
+};
+
+Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+Vec3 cross(const Vec3& a, const Vec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+// Symmetric 4x4 matrix accumulating the squared distance to a set of planes.
+// The weights are tracked so the error can be normalized back into squared distance
+struct Quadric {
+    double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2, w;
+
+    void addPlane(const Vec3& n, double d, double weight) {
+        a2 += weight * n.x * n.x;   b2 += weight * n.y * n.y;   c2 += weight * n.z * n.z;
+        ab += weight * n.x * n.y;   ac += weight * n.x * n.z;   bc += weight * n.y * n.z;
+        ad += weight * n.x * d;     bd += weight * n.y * d;     cd += weight * n.z * d;
+        d2 += weight * d * d;
+        w += weight;
+    }
+
+    void add(const Quadric& q) {
+        a2 += q.a2; b2 += q.b2; c2 += q.c2; ab += q.ab; ac += q.ac;
+        bc += q.bc; ad += q.ad; bd += q.bd; cd += q.cd; d2 += q.d2; w += q.w;
+    }
+
+    double error(const Vec3& p) const {
+        double e = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z
+                   + 2.0 * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z)
+                   + 2.0 * (ad * p.x + bd * p.y + cd * p.z) + d2;
+        return (w > 0.0) ? max(e, 0.0) / w : 0.0;
+    }
+};
+
+struct Collapse {
+    unsigned int from;      // class being removed
+    unsigned int to;        // class it merges into
+    double cost;
+};
+
+uint64_t edgeKey(unsigned int a, unsigned int b) {
+    if (a > b) swap(a, b);
+    return ((uint64_t) a << 32) | b;
+}
+
+}
+
+vector<unsigned int> simplifyMesh(const vector<unsigned int>& indices, const float* vertices, size_t stride,
+                                  size_t vertexCount, size_t targetIndexCount, float targetError, float* resultError) {
+    auto vertexData = [&](unsigned int v) { return (const char*) vertices + v * stride; };
+    auto position = [&](unsigned int v) {
+        const float* p = (const float*) vertexData(v);
+        return Vec3{ p[0], p[1], p[2] };
+    };
+
+    // Group vertices by position: cls[v] is the first vertex with v's position
+    vector<unsigned int> cls(vertexCount);
+    vector<bool> seam(vertexCount, false);
+    {
+        struct PositionHash {
+            size_t operator()(const Vec3& p) const {
+                float f[3] = { (float) p.x, (float) p.y, (float) p.z };
+                uint32_t h[3];
+                memcpy(h, f, sizeof(h));
+                return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+            }
+        };
+        struct PositionEqual {
+            bool operator()(const Vec3& a, const Vec3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+        };
+        unordered_map<Vec3, unsigned int, PositionHash, PositionEqual> byPosition;
+        byPosition.reserve(vertexCount);
+        for (unsigned int v = 0; v < vertexCount; v++) {
+            auto it = byPosition.emplace(position(v), v).first;
+            cls[v] = it->second;
+
+            // Same position but different normal/UV -> this position lies on a seam
+            if (cls[v] != v && memcmp(vertexData(v), vertexData(cls[v]), stride) != 0) seam[cls[v]] = true;
+        }
+    }
+
+    vector<bool> locked(seam);
+
+    // Lock the classes on open (or non-manifold) edges
+    {
+        unordered_map<uint64_t, int> edgeUse;
+        edgeUse.reserve(indices.size());
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            for (int k = 0; k < 3; k++)
+                edgeUse[edgeKey(cls[indices[t + k]], cls[indices[t + (k + 1) % 3]])]++;
+        for (auto& e : edgeUse) {
+            if (e.second == 2) continue;
+            locked[e.first >> 32] = true;
+            locked[e.first & 0xffffffffu] = true;
+        }
+    }
+
+    // Area weighted plane quadrics of the triangles around each class
+    vector<Quadric> quadrics(vertexCount, Quadric());
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        Vec3 p0 = position(indices[t]), p1 = position(indices[t + 1]), p2 = position(indices[t + 2]);
+        Vec3 n = cross(sub(p1, p0), sub(p2, p0));
+        double len = sqrt(dot(n, n));
+        if (len == 0.0) continue;
+        n = { n.x / len, n.y / len, n.z / len };
+        double d = -dot(n, p0);
+        for (int k = 0; k < 3; k++)
+            quadrics[cls[indices[t + k]]].addPlane(n, d, len * 0.5);
+    }
+
+    vector<unsigned int> result(indices);
+    double maxError = 0.0;
+    double errorLimit = (double) targetError * targetError;
+
+    vector<unsigned int> collapseTarget(vertexCount);   // vertex that each (removed) vertex is redirected to
+    vector<bool> touched(vertexCount);
+    vector<Collapse> candidates;
+
+    while (result.size() > targetIndexCount) {
+        // Triangles around each class (CSR)
+        vector<unsigned int> offsets(vertexCount + 1, 0);
+        for (auto v : result) offsets[cls[v] + 1]++;
+        for (size_t c = 0; c < vertexCount; c++) offsets[c + 1] += offsets[c];
+        vector<unsigned int> triangles(result.size());
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); i++) triangles[fill[cls[result[i]]]++] = i / 3;
+
+        // Every edge, in both directions
+        candidates.clear();
+        for (size_t t = 0; t < result.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = cls[result[t + k]], b = cls[result[t + (k + 1) % 3]];
+                Quadric q = quadrics[a];
+                q.add(quadrics[b]);
+                if (!locked[a]) candidates.push_back({ a, b, q.error(position(b)) });
+                if (!locked[b]) candidates.push_back({ b, a, q.error(position(a)) });
+            }
+        }
+        if (candidates.empty()) break;
+        sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        fill_n(touched.begin(), vertexCount, false);
+        for (size_t v = 0; v < vertexCount; v++) collapseTarget[v] = v;
+
+        size_t remaining = result.size();
+        int collapses = 0;
+        for (auto& c : candidates) {
+            if (c.cost > errorLimit || remaining <= targetIndexCount) break;
+            if (touched[c.from] || touched[c.to]) continue;
+
+            // All of `from`'s triangles must agree on which vertex of `to` they'd be joined to
+            // (copies with identical attributes count as the same vertex)
+            long toVertex = -1;
+            bool consistent = true;
+            for (unsigned int i = offsets[c.from]; i < offsets[c.from + 1] && consistent; i++) {
+                unsigned int t = triangles[i];
+                for (int k = 0; k < 3; k++) {
+                    unsigned int v = result[t * 3 + k];
+                    if (cls[v] != c.to) continue;
+                    if (toVertex != -1 && memcmp(vertexData(toVertex), vertexData(v), stride) != 0) consistent = false;
+                    toVertex = v;
+                }
+            }
+            if (!consistent || toVertex == -1) continue;
+
+            // Reject collapses that would flip a remaining triangle
+            Vec3 target = position(toVertex);
+            bool flips = false;
+            int removed = 0;
+            for (unsigned int i = offsets[c.from]; i < offsets[c.from + 1] && !flips; i++) {
+                unsigned int t = triangles[i];
+                Vec3 p[3];
+                int moved = -1;
+                bool degenerate = false;
+                for (int k = 0; k < 3; k++) {
+                    unsigned int v = result[t * 3 + k];
+                    if (cls[v] == c.to) degenerate = true;
+                    if (cls[v] == c.from) moved = k;
+                    p[k] = position(v);
+                }
+                if (degenerate) {
+                    removed++;
+                    continue;
+                }
+                Vec3 before = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+                p[moved] = target;
+                Vec3 after = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+                if (dot(before, after) <= 0.0) flips = true;
+            }
+            if (flips) continue;
+
+            // Apply the collapse: the neighbourhood of both ends is now stale until the next pass
+            for (unsigned int i = offsets[c.from]; i < offsets[c.from + 1]; i++)
+                for (int k = 0; k < 3; k++) touched[cls[result[triangles[i] * 3 + k]]] = true;
+            for (unsigned int i = offsets[c.to]; i < offsets[c.to + 1]; i++)
+                for (int k = 0; k < 3; k++) touched[cls[result[triangles[i] * 3 + k]]] = true;
+
+            collapseTarget[c.from] = toVertex;
+            quadrics[c.to].add(quadrics[c.from]);
+            maxError = max(maxError, c.cost);
+            remaining -= removed * 3;
+            collapses++;
+        }
+        if (collapses == 0) break;
+
+        // Rewrite the triangles & drop the ones that became degenerate
+        size_t write = 0;
+        for (size_t t = 0; t < result.size(); t += 3) {
+            unsigned int tri[3];
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = result[t + k];
+                tri[k] = (collapseTarget[cls[v]] != cls[v]) ? collapseTarget[cls[v]] : v;
+            }
+            if (cls[tri[0]] == cls[tri[1]] || cls[tri[1]] == cls[tri[2]] || cls[tri[0]] == cls[tri[2]]) continue;
+            result[write++] = tri[0];
+            result[write++] = tri[1];
+            result[write++] = tri[2];
+        }
+        result.resize(write);
+    }
+
+    if (resultError) *resultError = (float) sqrt(maxError);
+    return result;
+}
@@ -0,0 +1,21 @@
+#ifndef OPENGL_MESHSIMPLIFIER_H
+#define OPENGL_MESHSIMPLIFIER_H
+
+#include <cstddef>
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert 1997) by edge collapse.
+//
+// Vertices are only ever collapsed onto other existing vertices, so every level of detail can
+// share the original vertex buffer. Vertices are grouped by position, so meshes that were imported
+// without welding still simplify. Vertices on open boundaries & on attribute seams (the same position
+// with different normals/UVs) are locked so the silhouette & texture layout are preserved.
+//
+// `vertices` points at the first vertex: each is `stride` bytes, starting with its xyz position.
+// Simplification stops at targetIndexCount or when the next collapse would exceed targetError (in the
+// mesh's units). The largest error actually introduced is written to resultError, if given.
+std::vector<unsigned int> simplifyMesh(const std::vector<unsigned int>& indices, const float* vertices, size_t stride,
+                                       size_t vertexCount, size_t targetIndexCount, float targetError,
+                                       float* resultError = nullptr);
+
+#endif //OPENGL_MESHSIMPLIFIER_H
@@ -0,0 +1,320 @@
+#include "Mipmaps.h"
+#include "Assets.h"
+#include "Snapshot.h"
+#include "../lib/stb_image.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+static const char* CACHE_DIR = "cache/mips";
+static const uint32_t CACHE_MAGIC = 0x4350494d;     // "MIPC"
+static const uint32_t CACHE_VERSION = 1;
+
+// Chains that are being built in the background by prefetchMipChains, by path & filter (like the resource cache keys
+// textures by path & sampler: a chain built with another filter isn't the one asked for)
+static unordered_map<string, shared_future<MipChain>> pending;
+static mutex pendingLock;
+
+/*************************************************************
+                          Filters
+ *************************************************************/
+
+// 2x2 box filter: the vertical pass is channel-agnostic, so it runs over whole rows 16 bytes at a time
+static void boxDownsample(const MipLevel& src, MipLevel& dst, int channels) {
+    int rowBytes = src.width * channels;
+    vector<unsigned char> rowAvg(rowBytes);
+
+    for (int y = 0; y < dst.height; y++) {
+        const unsigned char* r0 = &src.data[(2 * y) * rowBytes];
+        const unsigned char* r1 = &src.data[min(2 * y + 1, src.height - 1) * rowBytes];
+
+        int i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= rowBytes; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(r0 + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(r1 + i));
+            _mm_storeu_si128((__m128i*)(&rowAvg[i]), _mm_avg_epu8(a, b));
+        }
+#endif
+        for (; i < rowBytes; i++)
+            rowAvg[i] = (unsigned char) ((r0[i] + r1[i] + 1) >> 1);
+
+        // Horizontal pass (clamped so odd widths don't read past the end of the row)
+        unsigned char* out = &dst.data[y * dst.width * channels];
+        for (int x = 0; x < dst.width; x++) {
+            int x0 = 2 * x * channels;
+            int x1 = min(2 * x + 1, src.width - 1) * channels;
+            for (int c = 0; c < channels; c++)
+                out[x * channels + c] = (unsigned char) ((rowAvg[x0 + c] + rowAvg[x1 + c] + 1) >> 1);
+        }
+    }
+}
+
+// Zeroth order modified Bessel function (used to build the Kaiser window)
+static double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 20; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Weights for a 6-tap Kaiser-windowed sinc that halves the resolution
+static const int KAISER_TAPS = 6;
+static const float* kaiserWeights() {
+    static float weights[KAISER_TAPS];
+    static once_flag initialized;
+    call_once(initialized, []() {
+        const double alpha = 4.0;
+        const double pi = 3.14159265358979323846;
+        double total = 0.0;
+        for (int t = 0; t < KAISER_TAPS; t++) {
+            double d = t - 2.5;     // distance from the output pixel's center, in source pixels
+            double x = d / 2.0;
+            double sinc = (x == 0.0) ? 1.0 : sin(pi * x) / (pi * x);
+            double r = d / 3.0;
+            double window = besselI0(alpha * sqrt(max(0.0, 1.0 - r * r))) / besselI0(alpha);
+            weights[t] = (float) (sinc * window);
+            total += weights[t];
+        }
+        for (float& w : weights) w = (float) (w / total);
+    });
+    return weights;
+}
+
+static void kaiserDownsample(const MipLevel& src, MipLevel& dst, int channels) {
+    const float* w = kaiserWeights();
+
+    // Horizontal pass into a float buffer (dst.width x src.height)
+    vector<float> tmp(dst.width * src.height * channels);
+    for (int y = 0; y < src.height; y++) {
+        const unsigned char* row = &src.data[y * src.width * channels];
+        float* out = &tmp[y * dst.width * channels];
+        for (int x = 0; x < dst.width; x++) {
+            for (int t = 0; t < KAISER_TAPS; t++) {
+                int sx = (src.width == 1) ? 0 : min(max(2 * x - 2 + t, 0), src.width - 1);
+                float wt = (src.width == 1) ? (t == 0 ? 1.0f : 0.0f) : w[t];
+                for (int c = 0; c < channels; c++)
+                    out[x * channels + c] += wt * row[sx * channels + c];
+            }
+        }
+    }
+
+    // Vertical pass - accumulating whole rows keeps the inner loop contiguous so it vectorizes
+    int rowFloats = dst.width * channels;
+    vector<float> acc(rowFloats);
+    for (int y = 0; y < dst.height; y++) {
+        fill(acc.begin(), acc.end(), 0.0f);
+        for (int t = 0; t < KAISER_TAPS; t++) {
+            int sy = (src.height == 1) ? 0 : min(max(2 * y - 2 + t, 0), src.height - 1);
+            float wt = (src.height == 1) ? (t == 0 ? 1.0f : 0.0f) : w[t];
+            const float* row = &tmp[sy * rowFloats];
+            for (int i = 0; i < rowFloats; i++)
+                acc[i] += wt * row[i];
+        }
+        unsigned char* out = &dst.data[y * rowFloats];
+        for (int i = 0; i < rowFloats; i++)
+            out[i] = (unsigned char) min(max(acc[i] + 0.5f, 0.0f), 255.0f);
+    }
+}
+
+void generateMips(MipChain& chain, MipFilter filter) {
+    chain.levels.resize(1);
+    while (chain.levels.back().width > 1 || chain.levels.back().height > 1) {
+        const MipLevel& src = chain.levels.back();
+        MipLevel dst;
+        dst.width = max(1, src.width / 2);
+        dst.height = max(1, src.height / 2);
+        dst.data.resize(dst.width * dst.height * chain.channels);
+
+        if (filter == MIP_KAISER)   kaiserDownsample(src, dst, chain.channels);
+        else                        boxDownsample(src, dst, chain.channels);
+
+        chain.levels.push_back(std::move(dst));
+    }
+}
+
+/*************************************************************
+                         Disk cache
+ *************************************************************/
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t filter;
+    uint32_t channels;
+    uint32_t numLevels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pad;
+    int64_t sourceSize;
+    int64_t sourceMTime;
+};
+
+static string cachePath(const string& path, MipFilter filter) {
+    stringstream name;
+    name << CACHE_DIR << "/" << hex << hash<string>()(path) << "_" << filter << ".mip";
+    return name.str();
+}
+
+static bool readCache(const string& path, MipFilter filter, MipChain& chain) {
+    int64_t size, mtime;
+    if (!assetStamp(path, size, mtime)) return false;
+
+    ifstream file(cachePath(path, filter), ios::binary);
+    if (!file) return false;
+
+    CacheHeader header;
+    if (!file.read((char*) &header, sizeof(header))) return false;
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.filter != (uint32_t) filter
+        || header.sourceSize != size || header.sourceMTime != mtime)
+        return false;   // stale entry - the source image has changed since it was cached
+
+    chain.channels = header.channels;
+    chain.levels.resize(header.numLevels);
+    int w = header.width, h = header.height;
+    for (auto& level : chain.levels) {
+        level.width = w;
+        level.height = h;
+        level.data.resize(w * h * chain.channels);
+        if (!file.read((char*) level.data.data(), level.data.size())) return false;
+        w = max(1, w / 2);
+        h = max(1, h / 2);
+    }
+    return true;
+}
+
+static void writeCache(const string& path, MipFilter filter, const MipChain& chain) {
+    int64_t size, mtime;
+    if (!assetStamp(path, size, mtime)) return;
+
+    mkdir("cache", 0755);
+    mkdir(CACHE_DIR, 0755);
+
+    // Write to a temporary file first so a concurrent reader never sees a half-written entry
+    string target = cachePath(path, filter);
+    string tmp = target + ".tmp";
+    ofstream file(tmp, ios::binary);
+    if (!file) return;
+
+    CacheHeader header = { CACHE_MAGIC, CACHE_VERSION, (uint32_t) filter, (uint32_t) chain.channels,
+                           (uint32_t) chain.levels.size(), (uint32_t) chain.width(), (uint32_t) chain.height(), 0,
+                           size, mtime };
+    file.write((const char*) &header, sizeof(header));
+    for (auto& level : chain.levels)
+        file.write((const char*) level.data.data(), level.data.size());
+    file.close();
+
+    if (file) rename(tmp.c_str(), target.c_str());
+    else remove(tmp.c_str());
+}
+
+/*************************************************************
+                          Snapshot
+ *************************************************************/
+
+static string snapshotKey(const string& path, MipFilter filter) {
+    return "mips:" + to_string(filter) + ":" + path;
+}
+
+static bool restoreChain(SnapshotReader& reader, MipChain& chain) {
+    chain.channels = reader.read<uint32_t>();
+    chain.levels.resize(reader.read<uint32_t>());
+    for (auto& level : chain.levels) {
+        level.width = reader.read<uint32_t>();
+        level.height = reader.read<uint32_t>();
+        size_t bytes = (size_t) level.width * level.height * chain.channels;
+        const unsigned char* data = reader.view(bytes);
+        if (!data) return false;
+        level.data.assign(data, data + bytes);
+    }
+    return reader.ok() && chain.valid();
+}
+
+static void recordChain(const string& key, const MipChain& chain) {
+    SnapshotWriter writer;
+    writer.write((uint32_t) chain.channels);
+    writer.write((uint32_t) chain.levels.size());
+    for (auto& level : chain.levels) {
+        writer.write((uint32_t) level.width);
+        writer.write((uint32_t) level.height);
+        writer.append(level.data.data(), level.data.size());
+    }
+    addSnapshot(key, std::move(writer));
+}
+
+/*************************************************************
+                          Loading
+ *************************************************************/
+
+static MipChain buildMipChain(const string& path, MipFilter filter) {
+    MipChain chain;
+    if (readCache(path, filter, chain)) return chain;
+
+    // Decoded straight from the archive mapping (or the loose file's bytes)
+    AssetData file = readAsset(path);
+    if (!file.valid()) return MipChain();
+
+    int width, height, nrChannels;
+    unsigned char* data = stbi_load_from_memory(file.data(), file.size(), &width, &height, &nrChannels, 0);
+    if (!data) return MipChain();
+
+    chain.channels = nrChannels;
+    chain.levels.resize(1);
+    chain.levels[0].width = width;
+    chain.levels[0].height = height;
+    chain.levels[0].data.assign(data, data + width * height * nrChannels);
+    stbi_image_free(data);
+
+    generateMips(chain, filter);
+    writeCache(path, filter, chain);
+    return chain;
+}
+
+MipChain loadMipChain(const string& path, MipFilter filter) {
+    snapshotDepends(path);
+
+    SnapshotReader reader;
+    MipChain chain;
+    if (findSnapshot(snapshotKey(path, filter), reader) && restoreChain(reader, chain)) return chain;
+
+    shared_future<MipChain> result;
+    {
+        lock_guard<mutex> guard(pendingLock);
+        auto it = pending.find(snapshotKey(path, filter));
+        if (it != pending.end()) {
+            result = it->second;
+            pending.erase(it);
+        }
+    }
+    chain = result.valid() ? result.get() : buildMipChain(path, filter);
+
+    if (snapshotRecording() && chain.valid()) recordChain(snapshotKey(path, filter), chain);
+    return chain;
+}
+
+void prefetchMipChains(const vector<string>& paths, MipFilter filter) {
+    lock_guard<mutex> guard(pendingLock);
+    for (auto& path : paths) {
+        SnapshotReader reader;
+        string key = snapshotKey(path, filter);
+        if (pending.count(key) || findSnapshot(key, reader)) continue;
+        pending[key] = async(launch::async, buildMipChain, path, filter).share();
+    }
+}
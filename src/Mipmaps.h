@@ -0,0 +1,36 @@
+#ifndef OPENGL_MIPMAPS_H
+#define OPENGL_MIPMAPS_H
+
+#include <string>
+#include <vector>
+
+// Filters used to downsample each level of a mip chain
+enum MipFilter { MIP_BOX, MIP_KAISER };
+
+struct MipLevel {
+    int width;
+    int height;
+    std::vector<unsigned char> data;    // tightly packed (no row padding)
+};
+
+// A full chain of pre-filtered levels, from the source image down to 1x1
+struct MipChain {
+    int channels = 0;
+    std::vector<MipLevel> levels;
+
+    bool valid() const { return channels > 0 && !levels.empty(); };
+    int width() const { return levels[0].width; };
+    int height() const { return levels[0].height; };
+};
+
+// Decode an image & build its mip chain, using the on-disk cache in cache/mips/ when it is up to date
+MipChain loadMipChain(const std::string& path, MipFilter = MIP_KAISER);
+
+// Start building the mip chains for several textures in parallel - a later loadMipChain call
+// for one of these paths picks up the result instead of doing the work itself
+void prefetchMipChains(const std::vector<std::string>& paths, MipFilter = MIP_KAISER);
+
+// Build the levels below the base level in place
+void generateMips(MipChain&, MipFilter);
+
+#endif //OPENGL_MIPMAPS_H
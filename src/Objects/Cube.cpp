@@ -1,4 +1,5 @@
 #include "Object.h"
+#include "../Shaders.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -57,20 +58,38 @@ Cube::Cube(GLuint s, Scene* sc) : Shape(s, sc) {
             1.0f,  1.0f,  1.0f,     0.0f,  1.0f,  0.0f,
             1.0f,  1.0f, -1.0f,     0.0f,  1.0f,  0.0f
     };
-    _bufferIDs.push_back( storeToVBO(vertices, sizeof(vertices)) );
-
     GLint posAttrib = glGetAttribLocation(_shaderProgram, "vPosition");
-    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
-    glEnableVertexAttribArray(posAttrib);
-
     GLint normAttrib = glGetAttribLocation(_shaderProgram, "vNormal");
-    glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE,  6 * sizeof(float), (void*)( 3 * sizeof(float) ));
+
+    if (COMPACT_VERTICES) {
+        // The cube already fills [-1, 1], so the default quantization is exact
+        _compact = true;
+
+        // 4 position components (the last is padding) + 2 octahedral normal components per vertex
+        int16_t packed[36 * 6];
+        for (int i = 0; i < 36; i++) {
+            packPosition(vec3(vertices[i*6], vertices[i*6+1], vertices[i*6+2]), _quantization, &packed[i*6]);
+            packNormal(vec3(vertices[i*6+3], vertices[i*6+4], vertices[i*6+5]), &packed[i*6+4]);
+        }
+        storeToVBO(packed, sizeof(packed));
+
+        glVertexAttribPointer(posAttrib, 3, GL_SHORT, GL_TRUE, 6 * sizeof(int16_t), 0);
+        glVertexAttribPointer(normAttrib, 2, GL_SHORT, GL_TRUE, 6 * sizeof(int16_t), (void*)( 4 * sizeof(int16_t) ));
+
+    } else {
+        storeToVBO(vertices, sizeof(vertices));
+
+        glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
+        glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE,  6 * sizeof(float), (void*)( 3 * sizeof(float) ));
+    }
+    glEnableVertexAttribArray(posAttrib);
     glEnableVertexAttribArray(normAttrib);
 
     unbind();
 }
 
 void Cube::setColor(vec3 color) {
+    _shaderProgram = fetchShaderVariant(_shaderProgram, shaderFeatures(_shaderProgram) | SHADER_VERTEX_COLOR);
     glBindVertexArray(_vao);
     glUseProgram(_shaderProgram);
 
@@ -93,7 +112,7 @@ void Cube::setColor(vec3 color) {
             color.x, color.y, color.z,      color.x, color.y, color.z,      color.x, color.y, color.z,
             color.x, color.y, color.z,      color.x, color.y, color.z,      color.x, color.y, color.z
     };
-    _bufferIDs.push_back( storeToVBO(colors, sizeof(colors)) );
+    storeToVBO(colors, sizeof(colors));
 
     GLint colAttrib = glGetAttribLocation(_shaderProgram, "vColor");
     glVertexAttribPointer(colAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
@@ -103,10 +122,11 @@ void Cube::setColor(vec3 color) {
 }
 
 void Cube::setColors(GLfloat* colors, int sizeC) {
+    _shaderProgram = fetchShaderVariant(_shaderProgram, shaderFeatures(_shaderProgram) | SHADER_VERTEX_COLOR);
     glBindVertexArray(_vao);
     glUseProgram(_shaderProgram);
 
-    _bufferIDs.push_back( storeToVBO(colors, sizeC) );
+    storeToVBO(colors, sizeC);
     GLint colAttrib = glGetAttribLocation(_shaderProgram, "vColor");
     glVertexAttribPointer(colAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(colAttrib);
@@ -115,12 +135,23 @@ void Cube::setColors(GLfloat* colors, int sizeC) {
 };
 
 void Cube::set2DTexture(std::string path) {
+    _shaderProgram = fetchShaderVariant(_shaderProgram, shaderFeatures(_shaderProgram) | SHADER_TEXTURED);
     glBindVertexArray(_vao);
     glUseProgram(_shaderProgram);
 
     _texture = storeTex(path, GL_CLAMP_TO_BORDER);
-    _textureIDs.push_back( _texture );
+    storeTexCoords();
+
+    // We're only binding 1 texture, so set it to texture unit 0
+    glActiveTexture(GL_TEXTURE0);
+    GLint uniSampleTex = glGetUniformLocation(_shaderProgram, "sampleTexture");
+    glUniform1i(uniSampleTex, 0);
 
+    unbind();
+};
+
+// Every face maps the whole texture (the VAO must be bound)
+void Cube::storeTexCoords() {
     GLfloat texCoords[] = {
             0.0f, 0.0f,     0.0f, 1.0f,    1.0f, 0.0f,       0.0f, 1.0f,     1.0f, 0.0f,    1.0f, 1.0f,
             0.0f, 0.0f,     0.0f, 1.0f,    1.0f, 0.0f,       0.0f, 1.0f,     1.0f, 0.0f,    1.0f, 1.0f,
@@ -129,20 +160,17 @@ void Cube::set2DTexture(std::string path) {
             0.0f, 0.0f,     0.0f, 1.0f,    1.0f, 0.0f,       0.0f, 1.0f,     1.0f, 0.0f,    1.0f, 1.0f,
             0.0f, 0.0f,     0.0f, 1.0f,    1.0f, 0.0f,       0.0f, 1.0f,     1.0f, 0.0f,    1.0f, 1.0f,
     };
-    _bufferIDs.push_back( storeToVBO(texCoords, sizeof(texCoords)) );
-
     GLint texAttrib = glGetAttribLocation(_shaderProgram, "vTexture");
-    glVertexAttribPointer(texAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    if (COMPACT_VERTICES) {
+        uint16_t halfTexCoords[36 * 2];
+        for (int i = 0; i < 36 * 2; i++)
+            halfTexCoords[i] = packHalf(texCoords[i]);
+        storeToVBO(halfTexCoords, sizeof(halfTexCoords));
+        glVertexAttribPointer(texAttrib, 2, GL_HALF_FLOAT, GL_FALSE, 0, 0);
+    } else {
+        storeToVBO(texCoords, sizeof(texCoords));
+        glVertexAttribPointer(texAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    }
     glEnableVertexAttribArray(texAttrib);
-
-    GLint uniTextureObj = glGetUniformLocation(_shaderProgram, "textureObject");
-    glUniform1i(uniTextureObj, 1);
-
-    // We're only binding 1 texture, so set it to texture unit 0
-    glActiveTexture(GL_TEXTURE0);
-    GLint uniSampleTex = glGetUniformLocation(_shaderProgram, "sampleTexture");
-    glUniform1i(uniSampleTex, 0);
-
-    unbind();
-};
+}
 
@@ -0,0 +1,168 @@
+#include "Object.h"
+#include "../Scene.h"
+#include "../Shaders.h"
+#include "../Jobs.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+
+using namespace glm;
+
+static const int INSTANCE_FLOATS = 16 + 4 + 1;     // model matrix, UV rectangle, layer
+static const size_t INSTANCE_CHUNK = 1024;          // cubes per job
+
+CubeBatch::CubeBatch(GLuint s, Scene* sc) : Cube(s, sc), _instanceData(nullptr), _instanceVBO(0) {
+    glBindVertexArray(_vao);
+    glUseProgram(_shaderProgram);
+
+    storeTexCoords();
+
+    // The instance data is rewritten every frame (the cubes can rotate)
+    _instanceVBO = storeToVBO(nullptr, 0);
+
+    unbind();
+}
+
+CubeBatch::~CubeBatch() {
+    for (auto& it : _instances)
+        transforms().remove(it.transform);
+}
+
+// Each cube gets its own slot in the scene's transform store, which the scene updates along with the objects'
+void CubeBatch::addCube(std::string texture, vec3 position, float size, vec3 axis, float speed) {
+    TransformStore& store = transforms();
+    uint32_t transform = store.add(_scene->time());
+    float terrainH = _scene->currTerrain()->getHeightAt(position.x, position.z);
+    store.setPosition(transform, vec3(position.x, position.y + terrainH, position.z));
+    store.setScale(transform, size);
+    store.setRotation(transform, axis, speed);
+    store.setBounds(transform, vec3(0.0f), 1.74f);     // the cube's corners are at +-1
+
+    _instances.push_back({ texture, transform, { 0, 0.0f, vec4(1.0f, 1.0f, 0.0f, 0.0f) } });
+}
+
+void CubeBatch::build() {
+    PROFILE_ZONE("CubeBatch::build");
+    glBindVertexArray(_vao);
+    glUseProgram(_shaderProgram);
+
+    // Each texture is packed once however many cubes use it, & sorted so that the same set of
+    // textures maps to the same cached arrays
+    std::vector<std::string> paths;
+    for (auto& it : _instances) paths.push_back(it.texture);
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+    // Clamped like a single cube's texture, so small mismatched textures can share an atlas
+    std::vector<TextureSlot> slots = storeTexArrays(paths, GL_CLAMP_TO_BORDER);
+    for (auto& it : _instances)
+        it.slot = slots[std::lower_bound(paths.begin(), paths.end(), it.texture) - paths.begin()];
+
+    // Cubes sharing an array are drawn together
+    std::stable_sort(_instances.begin(), _instances.end(),
+                     [](const Instance& a, const Instance& b) { return a.slot.texture < b.slot.texture; });
+
+    GLint uniSampleTex = glGetUniformLocation(_shaderProgram, "sampleTextures");
+    glUniform1i(uniSampleTex, 0);
+
+    if (DEBUG) {
+        int draws = 0;
+        for (int i = 0; i < _instances.size(); i++)
+            if (i == 0 || _instances[i].slot.texture != _instances[i - 1].slot.texture) draws++;
+        std::cout << "Batched " << _instances.size() << " cubes into " << draws << " draw call(s)" << std::endl;
+    }
+
+    unbind();
+}
+
+// Point the per-instance attributes at the given instance (offsetting the pointers stands in for base instance)
+void CubeBatch::setInstancePointers(int first) {
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceVBO);
+    size_t stride = INSTANCE_FLOATS * sizeof(GLfloat);
+    size_t base = first * stride;
+
+    // A mat4 attribute takes 4 consecutive locations, one per column
+    GLint modelAttrib = glGetAttribLocation(_shaderProgram, "iModel");
+    for (int c = 0; c < 4; c++) {
+        glVertexAttribPointer(modelAttrib + c, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + c * 4 * sizeof(GLfloat)));
+        glVertexAttribDivisor(modelAttrib + c, 1);
+        glEnableVertexAttribArray(modelAttrib + c);
+    }
+
+    GLint rectAttrib = glGetAttribLocation(_shaderProgram, "iUvRect");
+    glVertexAttribPointer(rectAttrib, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + 16 * sizeof(GLfloat)));
+    glVertexAttribDivisor(rectAttrib, 1);
+    glEnableVertexAttribArray(rectAttrib);
+
+    GLint layerAttrib = glGetAttribLocation(_shaderProgram, "iLayer");
+    glVertexAttribPointer(layerAttrib, 1, GL_FLOAT, GL_FALSE, stride, (void*)(base + 20 * sizeof(GLfloat)));
+    glVertexAttribDivisor(layerAttrib, 1);
+    glEnableVertexAttribArray(layerAttrib);
+}
+
+// Copy each cube's model matrix out of the transform store into this frame's instance data, in chunks across the
+// job system's threads
+void CubeBatch::prepare() {
+    TransformStore& store = transforms();
+    _instanceData = _scene->arena().allocate<GLfloat>(_instances.size() * INSTANCE_FLOATS);
+    JobSystem::get().parallelFor(_instances.size(), INSTANCE_CHUNK, [this, &store](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            Instance& it = _instances[i];
+            mat4 model = store.model(it.transform);
+
+            GLfloat* data = &_instanceData[i * INSTANCE_FLOATS];
+            std::copy(value_ptr(model), value_ptr(model) + 16, data);
+            std::copy(value_ptr(it.slot.uvRect), value_ptr(it.slot.uvRect) + 4, data + 16);
+            data[20] = it.slot.layer;
+        }
+    });
+}
+
+void CubeBatch::render() {
+    PROFILE_ZONE("CubeBatch::render");
+    PROFILE_GPU_ZONE("CubeBatch");
+    if (_instances.empty()) return;
+
+    glBindVertexArray(_vao);
+    glUseProgram(_shaderProgram);
+
+    // Orphan the old buffer so the driver doesn't have to wait for last frame's draw to finish with it
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceVBO);
+    size_t size = _instances.size() * INSTANCE_FLOATS * sizeof(GLfloat);
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, _instanceData);
+
+    GLint uniTransform = glGetUniformLocation(_shaderProgram, "VP");
+    glUniformMatrix4fv(uniTransform, 1, GL_FALSE, value_ptr(_scene->viewProjection()));
+    setVertexFormatUniforms();
+
+    if (_lit) {
+        GLint uniLightCol = glGetUniformLocation(_shaderProgram, "lightColor");
+        glUniform3fv(uniLightCol, 1, value_ptr(_scene->lightSource()->Color()));
+
+        GLint uniLightPos = glGetUniformLocation(_shaderProgram, "lightPos");
+        glUniform3fv(uniLightPos, 1, value_ptr(_scene->lightSource()->Position()));
+
+        GLint uniPosn = glGetUniformLocation(_shaderProgram, "viewPos");
+        glUniform3fv(uniPosn, 1, value_ptr(_scene->frame().cameraPosition));
+    }
+
+    // One bind & one instanced draw for each texture array
+    glActiveTexture(GL_TEXTURE0);
+    int first = 0;
+    for (int i = 1; i <= _instances.size(); i++) {
+        if (i < _instances.size() && _instances[i].slot.texture == _instances[first].slot.texture) continue;
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, _instances[first].slot.texture);
+        setInstancePointers(first);
+        beginShaderQuery(_shaderProgram);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, _numElements, i - first);
+        endShaderQuery();
+        first = i;
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    unbind();
+}
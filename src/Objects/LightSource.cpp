@@ -1,5 +1,6 @@
 #include "Object.h"
 #include "../Scene.h"
+#include "../Shaders.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -8,27 +9,28 @@ using namespace glm;
 
 LightSource::LightSource(GLuint s, Scene* sc, glm::vec3 lightPos, glm::vec3 lightCol) : Object(s, sc) {
 
-    _position = lightPos;
+    transforms().setPosition(_transform, lightPos);
     _color = lightCol;
     _onColor = lightCol;
     _changed = false;
 
-    _size = 0.05f;  // default size
-    float nSize = -1 * _size;
+    float size = 0.05f;  // default size
+    transforms().setScale(_transform, size);
+    float nSize = -1 * size;
 
     // Vertex data simply represents a small cube centered at the light position
     GLfloat points[] = {
             // Position                                           // Color
-            _size + lightPos.x,  _size + lightPos.y, _size + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
-            _size + lightPos.x,  _size + lightPos.y, nSize + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
-            _size + lightPos.x,  nSize + lightPos.y, _size + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
-            _size + lightPos.x,  nSize + lightPos.y, nSize + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
-            nSize + lightPos.x,  _size + lightPos.y, _size + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
-            nSize + lightPos.x,  _size + lightPos.y, nSize + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
-            nSize + lightPos.x,  nSize + lightPos.y, _size + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
+            size + lightPos.x,  size + lightPos.y, size + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
+            size + lightPos.x,  size + lightPos.y, nSize + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
+            size + lightPos.x,  nSize + lightPos.y, size + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
+            size + lightPos.x,  nSize + lightPos.y, nSize + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
+            nSize + lightPos.x,  size + lightPos.y, size + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
+            nSize + lightPos.x,  size + lightPos.y, nSize + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
+            nSize + lightPos.x,  nSize + lightPos.y, size + lightPos.z,  lightCol.x, lightCol.y, lightCol.z,
             nSize + lightPos.x,  nSize + lightPos.y, nSize + lightPos.z,  lightCol.x, lightCol.y, lightCol.z
     };
-    _bufferIDs.push_back( storeToVBO(points, sizeof(points)) );
+    _vbo = storeToVBO(points, sizeof(points));
 
     GLuint indices[] = {
             5, 7, 3,
@@ -49,7 +51,7 @@ LightSource::LightSource(GLuint s, Scene* sc, glm::vec3 lightPos, glm::vec3 ligh
             7, 6, 3,
             3, 6, 2
     };
-    _bufferIDs.push_back( storeToEBO(indices, sizeof(indices)) );
+    storeToEBO(indices, sizeof(indices));
 
     glUseProgram(_shaderProgram);
     GLint posAttrib = glGetAttribLocation(_shaderProgram, "vPosition");
@@ -62,33 +64,39 @@ LightSource::LightSource(GLuint s, Scene* sc, glm::vec3 lightPos, glm::vec3 ligh
 }
 
 void LightSource::render() {
+    PROFILE_ZONE("LightSource::render");
+    PROFILE_GPU_ZONE("LightSource");
     glBindVertexArray(_vao);
     glUseProgram(_shaderProgram);
 
     if (_changed) {
         // Update the vertex data
-        float nSize = -1 * _size;
+        vec3 p = position();
+        float size = this->size(), nSize = -1 * size;
         GLfloat points[] = {
-                _size + _position.x,  _size + _position.y, _size + _position.z,  _color.x, _color.y, _color.z,
-                _size + _position.x,  _size + _position.y, nSize + _position.z,  _color.x, _color.y, _color.z,
-                _size + _position.x,  nSize + _position.y, _size + _position.z,  _color.x, _color.y, _color.z,
-                _size + _position.x,  nSize + _position.y, nSize + _position.z,  _color.x, _color.y, _color.z,
-                nSize + _position.x,  _size + _position.y, _size + _position.z,  _color.x, _color.y, _color.z,
-                nSize + _position.x,  _size + _position.y, nSize + _position.z,  _color.x, _color.y, _color.z,
-                nSize + _position.x,  nSize + _position.y, _size + _position.z,  _color.x, _color.y, _color.z,
-                nSize + _position.x,  nSize + _position.y, nSize + _position.z,  _color.x, _color.y, _color.z
+                size + p.x,  size + p.y, size + p.z,  _color.x, _color.y, _color.z,
+                size + p.x,  size + p.y, nSize + p.z,  _color.x, _color.y, _color.z,
+                size + p.x,  nSize + p.y, size + p.z,  _color.x, _color.y, _color.z,
+                size + p.x,  nSize + p.y, nSize + p.z,  _color.x, _color.y, _color.z,
+                nSize + p.x,  size + p.y, size + p.z,  _color.x, _color.y, _color.z,
+                nSize + p.x,  size + p.y, nSize + p.z,  _color.x, _color.y, _color.z,
+                nSize + p.x,  nSize + p.y, size + p.z,  _color.x, _color.y, _color.z,
+                nSize + p.x,  nSize + p.y, nSize + p.z,  _color.x, _color.y, _color.z
         };
-        glBindBuffer(GL_ARRAY_BUFFER, _bufferIDs[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
         glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(points), points);
 
         _changed = false;
     }
 
-    mat4 MVP = _scene->camera()->ProjMatrix() * _scene->camera()->ViewMatrix() * mat4(1.0f);
+    mat4 MVP = _scene->viewProjection();
     GLint uniTranSizeform = glGetUniformLocation(_shaderProgram, "MVP");
     glUniformMatrix4fv(uniTranSizeform, 1, GL_FALSE, value_ptr(MVP));
+    setVertexFormatUniforms();
 
+    beginShaderQuery(_shaderProgram);
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
+    endShaderQuery();
 };
 
 void LightSource::setColor(glm::vec3 p) {
@@ -98,7 +106,7 @@ void LightSource::setColor(glm::vec3 p) {
 };
 
 void LightSource::setSize(float s) {
-    _size = s;
+    transforms().setScale(_transform, s);
     _changed = true;
 };
 
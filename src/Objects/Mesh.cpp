@@ -1,85 +1,293 @@
 #include "Object.h"
 #include "../Scene.h"
+#include "../Shaders.h"
+#include "../MeshSimplifier.h"
+#include "../MeshOptimizer.h"
+#include "../Snapshot.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 using namespace glm;
 
-Mesh::Mesh(GLuint s, Scene* sc) : Object(s, sc), _blend (true) {
+Mesh::Mesh(GLuint s, Scene* sc) : Object(s, sc), _vertexCount(0), _vertexBytes(0), _indexType(GL_UNSIGNED_INT), _indexBytes(0),
+        _center(0.0f), _radius(0.0f), _currentLod(0), _model(1.0f), _mvp(1.0f), _lod(0), _visible(true) {
+    _blendMode = BLEND_BLENDED;     // until the model says otherwise
     unbind();
 };
 
-void Mesh::addData(std::vector<Vertex> vert, std::vector<unsigned int> in, std::vector<Texture> tex) {
+void Mesh::addData(std::vector<Vertex>&& vert, std::vector<unsigned int>&& in, std::vector<Texture>&& tex, SnapshotWriter* record) {
+    _vertices = std::move(vert);
+    _indices = std::move(in);
+    setTextures(std::move(tex));
+
     glBindVertexArray(_vao);
     glUseProgram(_shaderProgram);
+    _vertexCount = _vertices.size();
 
-    _vertices = vert;
-    _indices = in;
-    _textures = tex;
+    generateLods();
 
-    _bufferIDs.push_back( storeToVBO(&_vertices[0], _vertices.size() * sizeof(Vertex)) );
-    _bufferIDs.push_back( storeToEBO(&_indices[0], _indices.size() * sizeof(unsigned int)) );
+    std::vector<CompactVertex> compact;
+    const void* vertexData = &_vertices[0];
+    _vertexBytes = _vertices.size() * sizeof(Vertex);
+    _compact = COMPACT_VERTICES;
+    if (_compact) {
+        // Quantize relative to this mesh's bounding box
+        _quantization = quantizationFor(&_vertices[0].position.x, _vertices.size(), sizeof(Vertex));
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        compact.resize(_vertices.size());
+        for (int i=0; i < _vertices.size(); i++) {
+            packPosition(_vertices[i].position, _quantization, compact[i].position);
+            packNormal(_vertices[i].normal, compact[i].normal);
+            compact[i].texCoords[0] = packHalf(_vertices[i].texCoords.x);
+            compact[i].texCoords[1] = packHalf(_vertices[i].texCoords.y);
+        }
+        vertexData = &compact[0];
+        _vertexBytes = compact.size() * sizeof(CompactVertex);
+    }
 
-    // vertex normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    std::vector<GLushort> shortIndices;
+    const void* indexData = &_indices[0];
+    _indexType = GL_UNSIGNED_INT;
+    _indexBytes = _indices.size() * sizeof(GLuint);
+    if (_vertices.size() <= 65536) {
+        shortIndices.assign(_indices.begin(), _indices.end());
+        indexData = &shortIndices[0];
+        _indexType = GL_UNSIGNED_SHORT;
+        _indexBytes = shortIndices.size() * sizeof(GLushort);
+    }
 
-    // vertex texture coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+    upload(vertexData, indexData);
+    if (record) {
+        // Everything restore() needs, in the order it reads it
+        record->write((uint64_t) _vertexCount);
+        record->write((uint8_t) _compact);
+        record->write(_quantization);
+        record->write(_center);
+        record->write(_radius);
+        record->write((uint32_t) _lods.size());
+        for (auto& lod : _lods) record->write(lod);
+        record->write((uint32_t) _indexType);
+        record->write((uint32_t) _textures.size());
+        for (auto& it : _textures) {
+            record->write(it.name);
+            record->write(it.path);
+        }
+        record->write((uint64_t) _vertexBytes);
+        record->write((uint64_t) _indexBytes);
+        record->append(vertexData, _vertexBytes);
+        record->append(indexData, _indexBytes);
+    }
 
-    // Load the textures
-    for (auto& it : _textures) {
-        it.id = storeTex( it.path );
-        _textureIDs.push_back( it.id );
+    // Only the LOD ranges are needed to draw from here on
+    if (!RETAIN_GEOMETRY) {
+        std::vector<Vertex>().swap(_vertices);
+        std::vector<unsigned int>().swap(_indices);
     }
 
     unbind();
 };
 
-void Mesh::render() {
+// The mesh as addData recorded it, uploaded straight out of the scene snapshot (there are no CPU copies)
+bool Mesh::restore(SnapshotReader& reader) {
+    _vertexCount = reader.read<uint64_t>();
+    _compact = reader.read<uint8_t>();
+    _quantization = reader.read<Quantization>();
+    _center = reader.read<vec3>();
+    _radius = reader.read<float>();
+    transforms().setBounds(_transform, _center, _radius);
+    uint32_t numLods = reader.read<uint32_t>();
+    if (numLods == 0 || numLods > MAX_LODS) return false;
+    _lods.resize(numLods);
+    for (auto& lod : _lods) lod = reader.read<Lod>();
+    _indexType = reader.read<uint32_t>();
+
+    std::vector<Texture> textures(reader.read<uint32_t>());
+    for (auto& it : textures) {
+        it.name = reader.readString();
+        it.path = reader.readString();
+    }
+    _vertexBytes = reader.read<uint64_t>();
+    _indexBytes = reader.read<uint64_t>();
+    const unsigned char* vertexData = reader.view(_vertexBytes);
+    const unsigned char* indexData = reader.view(_indexBytes);
+    if (!reader.ok() || _compact != COMPACT_VERTICES) return false;
+
+    setTextures(std::move(textures));
     glBindVertexArray(_vao);
     glUseProgram(_shaderProgram);
+    upload(vertexData, indexData);
+    unbind();
+    return true;
+}
+
+void Mesh::setTextures(std::vector<Texture>&& tex) {
+    _textures = std::move(tex);
+
+    // Only meshes with a specular map use the variant that samples one
+    for (auto& it : _textures) {
+        if (it.name.compare(0, 17, "specular_texture_") == 0)
+            _shaderProgram = fetchShaderVariant(_shaderProgram, shaderFeatures(_shaderProgram) | SHADER_SPECULAR_MAP);
+    }
+    locateUniforms();
+}
+
+// Stores the vertices (in the format _compact says they're in) & the indices
+void Mesh::upload(const void* vertexData, const void* indexData) {
+    storeToVBO(vertexData, _vertexBytes);
+
+    if (_compact) {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+
+        // vertex normals (octahedral)
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoords));
+
+    } else {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+    }
+
+    storeToEBO(indexData, _indexBytes);
+}
+
+// Simplify the mesh into progressively coarser levels, appended to the index buffer after the full detail one
+void Mesh::generateLods() {
+    PROFILE_ZONE("Mesh::generateLods");
+    _lods.clear();
+    _lods.push_back({ 0, (unsigned int) _indices.size(), 0.0f });
+    if (_vertices.empty()) return;
+
+    // Bounding sphere around the center of the bounding box
+    vec3 lo = _vertices[0].position, hi = lo;
+    for (auto& v : _vertices) {
+        lo = min(lo, v.position);
+        hi = max(hi, v.position);
+    }
+    _center = (lo + hi) * 0.5f;
+    _radius = 0.0f;
+    for (auto& v : _vertices)
+        _radius = max(_radius, distance(v.position, _center));
+    transforms().setBounds(_transform, _center, _radius);
+
+    // Room for every level up front, so appending them never reallocates
+    float ratios = 0.0f;
+    for (auto r : LOD_TRIANGLE_RATIOS) ratios += r;
+    std::vector<unsigned int> all;
+    all.reserve(size_t(_indices.size() * ratios) + 3 * MAX_LODS);
+    all.insert(all.end(), _indices.begin(), _indices.end());
+    std::vector<unsigned int> previous = _indices;
+    for (int i = 1; i < MAX_LODS; i++) {
+        size_t target = size_t(_indices.size() / 3 * LOD_TRIANGLE_RATIOS[i]) * 3;
+        float error = 0.0f;
+        std::vector<unsigned int> lod = simplifyMesh(previous, &_vertices[0].position.x, sizeof(Vertex), _vertices.size(),
+                                                     target, LOD_ERRORS[i] * _radius, &error);
+
+        // Stop once simplification stops paying for itself (locked boundaries/seams, or the error limit)
+        if (lod.empty() || lod.size() > previous.size() * 9 / 10) break;
+
+        optimizeVertexCache(lod, _vertices.size());
+        _lods.push_back({ (unsigned int) all.size(), (unsigned int) lod.size(), _lods.back().error + error });
+        all.insert(all.end(), lod.begin(), lod.end());
+        previous.swap(lod);
+    }
+    _indices.swap(all);
+}
+
+// Pick the level of detail from how many pixels its error would cover (with a hysteresis band to prevent popping)
+int Mesh::selectLod() {
+    const FramePacket& frame = _scene->frame();
+    TransformStore& store = transforms();
+    float dist = max(distance(store.worldCenter(_transform), frame.cameraPosition) - store.worldRadius(_transform), 0.1f);
+    float pixelsPerUnit = (frame.screenHeight / 2.0f) / (dist * tan(frame.fieldOfView / 2.0f));
+
+    float size = store.scale(_transform);
+    auto pixelError = [&](int lod) { return _lods[lod].error * size * pixelsPerUnit; };
 
-    // Some models dont have RGBA textures so blending messes with them
-    if (!_blend) glDisable(GL_BLEND);
+    int coarser = _currentLod;
+    for (int i = _currentLod + 1; i < _lods.size(); i++)
+        if (pixelError(i) <= LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS)) coarser = i;
+
+    if (coarser != _currentLod) _currentLod = coarser;
+    else while (_currentLod > 0 && pixelError(_currentLod) > LOD_PIXEL_ERROR * (1.0f + LOD_HYSTERESIS)) _currentLod--;
+
+    return _currentLod;
+}
+
+// The model packs the textures of all its materials together (see Model::Model)
+void Mesh::setTextureSlots(const std::unordered_map<std::string, TextureSlot>& slots) {
+    for (auto& it : _textures) {
+        auto slot = slots.find(it.path);
+        if (slot == slots.end()) continue;
+        it.id = slot->second.texture;
+        it.layer = slot->second.layer;
+    }
+}
+
+// Whenever the program changes, rather than each draw: the names are built here (most are past the small string
+// optimization), & a mesh that's culled until a steady frame mustn't allocate in it (see Scene::checkAllocations)
+void Mesh::locateUniforms() {
+    for (auto& it : _textures) {
+        it.samplerLocation = glGetUniformLocation(_shaderProgram, it.name.c_str());
+        it.layerLocation = glGetUniformLocation(_shaderProgram, (it.name + "_layer").c_str());
+    }
+}
+
+void Mesh::isLit(bool lit) {
+    Object::isLit(lit);
+    locateUniforms();
+}
+
+void Mesh::setBlendMode(BlendMode mode) {
+    _blendMode = mode;
+    unsigned int features = shaderFeatures(_shaderProgram);
+    features = (mode == BLEND_ALPHA_TESTED) ? (features | SHADER_ALPHA_TEST) : (features & ~SHADER_ALPHA_TEST);
+    _shaderProgram = fetchShaderVariant(_shaderProgram, features);
+    locateUniforms();
+}
+
+// Alpha-to-coverage only does something with a multisampled framebuffer
+static bool multisampled() {
+    static GLint samples = -1;
+    if (samples < 0) glGetIntegerv(GL_SAMPLES, &samples);
+    return samples > 1;
+}
+
+void Mesh::render() {
+    PROFILE_ZONE("Mesh::render");
+    if (!_visible) return;
+
+    glBindVertexArray(_vao);
+    glUseProgram(_shaderProgram);
 
     // Bind the textures
     for(int i=0; i < _textures.size(); i++) {
         // Tell the shader where to find which texture by binding each texture to a unique texture unit
         glActiveTexture(GL_TEXTURE0 + i);
-        GLuint uniLoc = glGetUniformLocation(_shaderProgram, _textures[i].name.c_str());
-        glUniform1i(uniLoc, i);
+        glUniform1i(_textures[i].samplerLocation, i);
+        glUniform1f(_textures[i].layerLocation, _textures[i].layer);
 
-        glBindTexture(GL_TEXTURE_2D, _textures[i].id);
-    }
-
-    mat4 rot(1.0f);
-    if (_rotationAxis != vec3(0.0f)) {
-        // Speed is set -> rotation as a factor of time in the specified axis
-        if (_rotationSpeed != 0) {
-            auto now = std::chrono::high_resolution_clock::now();
-            float timeDiff = std::chrono::duration_cast<std::chrono::duration<float>>(now - _start).count();
-            rot = rotate(mat4(1.0f), timeDiff * _rotationSpeed * radians(360.f), _rotationAxis);
-        }
-
-        // Speed is not set -> static rotation so object simply faces the given axis
-        else {
-            vec3 forward = vec3(0.0f, 0.0f, 1.0f);
-            float angle = acos( dot(forward, _rotationAxis) / (length(forward) * length(_rotationAxis)) );
-            rot = rotate(mat4(1.0f), angle, _rotationAxis);
-        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, _textures[i].id);
     }
 
     // Pass the MVP matrix into our shader
-    mat4 model = translate(mat4(1.0f), _position) * rot * scale(mat4(1.0f), vec3(_size, _size, _size));
-    mat4 MVP = _scene->camera()->ProjMatrix() * _scene->camera()->ViewMatrix() * model;
+    mat4 model = _model;
     GLint uniTransform = glGetUniformLocation(_shaderProgram, "MVP");
-    glUniformMatrix4fv(uniTransform, 1, GL_FALSE, value_ptr(MVP));
+    glUniformMatrix4fv(uniTransform, 1, GL_FALSE, value_ptr(_mvp));
+    setVertexFormatUniforms();
 
     if (_lit) {
         // Needed: light color, light position, model matrix, current position
@@ -93,27 +301,70 @@ void Mesh::render() {
         glUniformMatrix4fv(uniModel, 1, GL_FALSE, value_ptr(model));
 
         GLint uniPosn = glGetUniformLocation(_shaderProgram, "viewPos");
-        glUniform3fv(uniPosn, 1, value_ptr(_scene->camera()->Position()));
+        glUniform3fv(uniPosn, 1, value_ptr(_scene->frame().cameraPosition));
+    }
 
-    } else {
-        // Set lightColor = 0 so the fragment shader knows not to try to light the shape
-        GLint uniLightCol = glGetUniformLocation(_shaderProgram, "lightColor");
-        glUniform3fv(uniLightCol, 1, value_ptr(vec3(0.0f)));
+    // Record what each policy would draw, then draw with the active one
+    _scene->countTriangles(LOD_FULL_DETAIL, _lods[0].count / 3);
+    _scene->countTriangles(LOD_SCREEN_SIZE, _lods[_lod].count / 3);
+    int lod = (_scene->lodPolicy() == LOD_FULL_DETAIL) ? 0 : _lod;
+
+    // Cut-outs fade their edges out through the sample coverage when there are samples to cover
+    bool coverage = (_blendMode == BLEND_ALPHA_TESTED) && multisampled();
+    if (_blendMode == BLEND_ALPHA_TESTED) {
+        GLint uniCutoff = glGetUniformLocation(_shaderProgram, "alphaCutoff");
+        glUniform1f(uniCutoff, coverage ? COVERAGE_CUTOFF : ALPHA_CUTOFF);
     }
+    if (coverage) glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
 
-    glDrawElements(GL_TRIANGLES, _indices.size(), GL_UNSIGNED_INT, 0);
+    // Only the visible fragments are shaded if the depth is already there
+    if (_depthDrawn) glDepthFunc(GL_EQUAL);
+    beginShaderQuery(_shaderProgram);
+    glDrawElements(GL_TRIANGLES, _lods[lod].count, _indexType, (void*)(_lods[lod].offset * indexSize()));
+    endShaderQuery();
+    if (_depthDrawn) glDepthFunc(GL_LESS);
+    _depthDrawn = false;
 
-    // Re-enable blending
-    if (!_blend) glEnable(GL_BLEND);
+    if (coverage) glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
 
     unbind();
 };
 
+void Mesh::renderDepth(GLuint program) {
+    PROFILE_ZONE("Mesh::renderDepth");
+    // Blended meshes have to be drawn over what's behind them (& cut-outs would need the texture to be sampled)
+    if (_blendMode != BLEND_OPAQUE || !_visible) return;
+
+    glBindVertexArray(_vao);
+    glUseProgram(program);
+
+    GLint uniTransform = glGetUniformLocation(program, "MVP");
+    glUniformMatrix4fv(uniTransform, 1, GL_FALSE, value_ptr(_mvp));
+    setVertexFormatUniforms(program);
+
+    int lod = (_scene->lodPolicy() == LOD_FULL_DETAIL) ? 0 : _lod;
+    glDrawElements(GL_TRIANGLES, _lods[lod].count, _indexType, (void*)(_lods[lod].offset * indexSize()));
+    _depthDrawn = true;
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+// The model matrix (the rotation depends on the time) & level of detail for this frame
+void Mesh::prepare() {
+    TransformStore& store = transforms();
+    _model = store.model(_transform);
+    _mvp = _scene->viewProjection() * _model;
+
+    _visible = store.visible(_transform);
+    if (_visible) _lod = selectLod();
+}
+
 void Mesh::unbind() {
     // Unbind all the textures
     for(int i=0; i < _textures.size(); i++) {
         glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     }
 
     glBindVertexArray(0);
@@ -1,10 +1,63 @@
 #include "Object.h"
 #include "../Shaders.h"
 #include "../Scene.h"
+#include "../MeshOptimizer.h"
+#include "../Assets.h"
+#include "../Snapshot.h"
 
-Model::Model(std::string path, GLuint shader, Scene* sc) : Object(shader, sc) {
+#include <algorithm>
+
+Model::Model(std::string path, GLuint shader, Scene* sc) : Object(shader, sc), _importedVertices(0), _recording(nullptr) {
+    PROFILE_ZONE("Model::Model");
+    _pathRoot = path.substr(0, path.find_last_of('/'));
+    _profileName = profileName(path.substr(path.find_last_of('/') + 1));
+    _blendMode = BLEND_BLENDED;
+
+    // The snapshot has no CPU copies of the geometry to retain, so those models are always imported
+    std::vector<std::string> texturePaths;
+    if (RETAIN_GEOMETRY || !restore(path, shader, sc, texturePaths)) {
+        if (!import(path, shader, sc, texturePaths)) return;
+    }
+
+    // Textures of the same size go into shared arrays, so the materials differ only by layer
+    // (the UVs can repeat, so nothing is atlased)
+    glBindVertexArray(0);
+    std::vector<TextureSlot> slots = storeTexArrays(texturePaths);
+    std::unordered_map<std::string, TextureSlot> slotsByPath;
+    for (int i=0; i < texturePaths.size(); i++)
+        slotsByPath[texturePaths[i]] = slots[i];
+    for (auto it : _meshes)
+        it->setTextureSlots(slotsByPath);
+    if (DEBUG) std::cout << "Succesfully loaded data for model: " << _pathRoot << std::endl;
+
+    if (DEBUG) {
+        // Vertex & index memory compared to what was imported: unwelded 32 byte float vertices & 32 bit indices
+        size_t vertices = 0, bytes = 0, importedBytes = _importedVertices * sizeof(Mesh::Vertex);
+        size_t indexBytes = 0, lodBytes = 0, importedIndexBytes = 0;
+        for (auto it : _meshes) {
+            vertices += it->vertexCount();
+            bytes += it->vertexBytes();
+            indexBytes += it->indexCount() * it->indexSize();
+            lodBytes += it->indexBytes() - it->indexCount() * it->indexSize();
+            importedIndexBytes += it->indexCount() * sizeof(GLuint);
+        }
+        auto saved = [](size_t now, size_t before) { return 100 - (before ? 100 * now / before : 100); };
+        std::cout << "Vertex data for " << _pathRoot << ": " << _importedVertices << " -> " << vertices << " vertices, "
+                  << importedBytes / 1024 << "KB -> " << bytes / 1024 << "KB (" << saved(bytes, importedBytes)
+                  << "% saved)" << std::endl;
+        std::cout << "Index data for " << _pathRoot << ": " << importedIndexBytes / 1024 << "KB -> " << indexBytes / 1024
+                  << "KB (" << saved(indexBytes, importedIndexBytes) << "% saved, plus " << lodBytes / 1024
+                  << "KB for the LODs)" << std::endl;
+    }
+}
+
+// Loads the model with assimp & cooks its meshes
+bool Model::import(std::string path, GLuint shader, Scene* sc, std::vector<std::string>& texturePaths) {
+    PROFILE_ZONE("Model::import");
     // Load the model into an assimp scene object
     Assimp::Importer importer;
+    AssetIOSystem* io = new AssetIOSystem();
+    importer.SetIOHandler(io);     // the importer deletes it
     const aiScene* aiscene = importer.ReadFile(path,
                                              aiProcess_Triangulate // We want all primitives to be triangles
                                              | aiProcess_FlipUVs); // Flip the texture y-coordinate where necessary
@@ -17,19 +70,69 @@ Model::Model(std::string path, GLuint shader, Scene* sc) : Object(shader, sc) {
 
     if (!aiscene || aiscene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !aiscene->mRootNode) {
         std::cout << "Error loading model at " << path << ": " << importer.GetErrorString() << std::endl;
-        return;
+        return false;
     }
+    for (auto& it : io->opened())
+        snapshotDepends(it);    // the model file, its materials, ...
 
-    _pathRoot = path.substr(0, path.find_last_of('/'));
+    // Kick off the texture decoding for every material up front so it overlaps with the mesh processing
+    for (int i=0; i < aiscene->mNumMaterials; i++) {
+        for (auto type : { aiTextureType_AMBIENT, aiTextureType_DIFFUSE, aiTextureType_SPECULAR }) {
+            for (auto& tex : getTextures(aiscene->mMaterials[i], type, "", _pathRoot)) {
+                if (std::find(texturePaths.begin(), texturePaths.end(), tex.path) == texturePaths.end())
+                    texturePaths.push_back(tex.path);
+            }
+        }
+    }
+    prefetchTextures(texturePaths);
 
     // Recursively processes the nodes & saves the generated meshes in the _meshes vector
+    SnapshotWriter meshes;
+    _recording = snapshotRecording() ? &meshes : nullptr;
     processNode(aiscene->mRootNode, aiscene, shader, sc);
-    if (DEBUG) std::cout << "Succesfully loaded data for model: " << _pathRoot << std::endl;
+    _recording = nullptr;
+
+    if (snapshotRecording()) {
+        SnapshotWriter writer;
+        writer.write((uint32_t) texturePaths.size());
+        for (auto& it : texturePaths) writer.write(it);
+        writer.write((uint64_t) _importedVertices);
+        writer.write((uint32_t) _meshes.size());
+        writer.append(meshes.data().data(), meshes.data().size());
+        addSnapshot("model:" + path, std::move(writer));
+    }
+    return true;
 }
 
-Model::~Model() {
-    glDeleteProgram(_shaderProgram);
+// Loads the cooked meshes from the scene snapshot
+bool Model::restore(std::string path, GLuint shader, Scene* sc, std::vector<std::string>& texturePaths) {
+    PROFILE_ZONE("Model::restore");
+    SnapshotReader reader;
+    if (!findSnapshot("model:" + path, reader)) return false;
+
+    texturePaths.resize(reader.read<uint32_t>());
+    for (auto& it : texturePaths) it = reader.readString();
+    prefetchTextures(texturePaths);
+    _importedVertices = reader.read<uint64_t>();
 
+    uint32_t numMeshes = reader.read<uint32_t>();
+    bool restored = reader.ok();
+    for (uint32_t i = 0; i < numMeshes && restored; i++) {
+        _meshes.push_back(new Mesh(shader, sc));
+        restored = _meshes.back()->restore(reader);
+    }
+    if (restored) return true;
+
+    // Baked with other settings (or truncated), so import it after all
+    for (auto it : _meshes)
+        delete it;
+    _meshes.clear();
+    texturePaths.clear();
+    _importedVertices = 0;
+    return false;
+}
+
+Model::~Model() {
     for (auto it : _meshes)
         delete it;  // Just calls the Object destructor
     _meshes.clear();
@@ -70,6 +173,8 @@ Mesh* Model::processMesh(aiMesh* mesh, const aiScene* aiscene, GLuint s, Scene*
 
     std::vector<Mesh::Vertex> vertices;
     std::vector<unsigned int> indices;
+    vertices.reserve(mesh->mNumVertices);
+    indices.reserve(mesh->mNumFaces * 3);     // aiProcess_Triangulate
 
     // Retrieve vertex data
     for(int i=0; i < mesh->mNumVertices; i++) {
@@ -106,6 +211,14 @@ Mesh* Model::processMesh(aiMesh* mesh, const aiScene* aiscene, GLuint s, Scene*
             indices.push_back(face.mIndices[j]);
     }
 
+    // Merge the duplicated vertices so the post-transform cache can actually reuse them
+    _importedVertices += vertices.size();
+    vertices.resize(weldVertices(indices, &vertices[0], sizeof(Mesh::Vertex), vertices.size()));
+
+    // Reorder for the post-transform cache, overdraw & fetch locality
+    auto remap = optimizeMesh(indices, &vertices[0].position.x, sizeof(Mesh::Vertex), vertices.size(), _pathRoot);
+    remapVertices(vertices, remap);
+
     // Retrieve material (texture) data
     aiMaterial* mat = aiscene->mMaterials[mesh->mMaterialIndex];
     auto ambient = getTextures(mat, aiTextureType_AMBIENT, "ambient_texture_", _pathRoot);
@@ -118,18 +231,32 @@ Mesh* Model::processMesh(aiMesh* mesh, const aiScene* aiscene, GLuint s, Scene*
     textures.insert( textures.end(), diffuse.begin(), diffuse.end() );
     textures.insert( textures.end(), specular.begin(), specular.end() );
 
-    newMesh->addData(vertices, indices, textures);
+    newMesh->addData(std::move(vertices), std::move(indices), std::move(textures), _recording);
     return newMesh;
 }
 
+void Model::prepare() {
+    for (auto it : _meshes)
+        it->prepare();
+}
+
 void Model::render() {
+    PROFILE_ZONE("Model::render");
+    PROFILE_GPU_ZONE(_profileName);
     for (auto it : _meshes)
         it->render();
 }
 
-void Model::setBlend(bool b) {
+void Model::renderDepth(GLuint program) {
+    PROFILE_ZONE("Model::renderDepth");
+    for (auto it : _meshes)
+        it->renderDepth(program);
+}
+
+void Model::setBlendMode(BlendMode mode) {
+    _blendMode = mode;
     for (auto it : _meshes)
-        it->setBlend(b);
+        it->setBlendMode(mode);
 }
 
 void Model::isLit(bool b) {
@@ -138,6 +265,7 @@ void Model::isLit(bool b) {
 }
 
 void Model::setPosition(glm::vec3 p) {
+    Object::setPosition(p);     // for sorting
     for (auto it : _meshes)
         it->setPosition(p);
 };
@@ -1,35 +1,68 @@
 #include "Object.h"
 #include "../Scene.h"
+#include "../Mipmaps.h"
+#include "../TexturePacker.h"
+#include "../Shaders.h"
+
+#include <glm/gtc/type_ptr.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../../lib/stb_image.h"
 
-Object::Object(GLuint s, Scene* sc) :_shaderProgram(s), _scene(sc),
-    _lit(true), _position(glm::vec3(0.0)), _size(1.0f), _rotationAxis(glm::vec3(0.0)), _rotationSpeed(0.0f) {
-    _start = std::chrono::high_resolution_clock::now();
+Object::Object(GLuint s, Scene* sc) :_shaderProgram(s), _scene(sc), _compact(false),
+    _lit(true), _depthDrawn(false), _blendMode(BLEND_OPAQUE) {
+    _transform = transforms().add(_scene->time());     // animations start now
     _vao = initializeVAO();
 };
 
 
 Object::~Object() {     // Note: Gets called after each child class' destructor is finished
+    transforms().remove(_transform);
     glDeleteVertexArrays(1, &_vao);
 
-    for (auto it : _bufferIDs)
-        glDeleteBuffers(1, &it);
-    _bufferIDs.clear();
+    // Textures may be shared with other objects, so the resource manager decides when they're deleted
+    for (auto it : _resources)
+        ResourceManager::get().release(it);
+    _resources.clear();
 
-    for (auto it : _textureIDs)
-        glDeleteTextures(1, &it);
-    _textureIDs.clear();
+    // Don't delete shader program because it's shared by every object using the same variant (see fetchShader)
+}
 
-    // Don't delete shader program because some subclasses (ie Meshes) share them
+void Object::isLit(bool b) {
+    _lit = b;
+    unsigned int features = shaderFeatures(_shaderProgram);
+    _shaderProgram = fetchShaderVariant(_shaderProgram, b ? (features | SHADER_LIT) : (features & ~SHADER_LIT));
 }
 
 void Object::setPosition(glm::vec3 p) {
     float terrainH = _scene->currTerrain()->getHeightAt(p.x, p.z);
-    _position = glm::vec3(p.x, p.y + terrainH, p.z);
+    transforms().setPosition(_transform, glm::vec3(p.x, p.y + terrainH, p.z));
 };
 
+void Object::setSize(float s) {
+    transforms().setScale(_transform, s);
+}
+
+void Object::setRotation(glm::vec3 axis) {
+    transforms().setRotation(_transform, axis, 0.0f);
+}
+
+void Object::setRotation(glm::vec3 axis, float speed) {
+    transforms().setRotation(_transform, axis, speed);
+}
+
+glm::vec3 Object::position() {
+    return transforms().position(_transform);
+}
+
+float Object::size() {
+    return transforms().scale(_transform);
+}
+
+TransformStore& Object::transforms() {
+    return _scene->transforms();
+}
+
 // Create & bind a vertex array object
 GLuint Object::initializeVAO() {
     GLuint vao;
@@ -38,25 +71,31 @@ GLuint Object::initializeVAO() {
     return vao;
 }
 
-// Create, bind, and load data into a vertex buffer object
-GLuint Object::storeToVBO(GLfloat* vertices, int size) {
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
-    return vbo;
+// Tell the vertex shader how to decode this object's vertex data (the shader program must be bound)
+void Object::setVertexFormatUniforms(GLuint program) {
+    if (!program) program = _shaderProgram;
+    GLint uniCompact = glGetUniformLocation(program, "compactVertices");
+    glUniform1i(uniCompact, _compact);
+
+    GLint uniScale = glGetUniformLocation(program, "posScale");
+    glUniform3fv(uniScale, 1, glm::value_ptr(_quantization.scale));
+
+    GLint uniOffset = glGetUniformLocation(program, "posOffset");
+    glUniform3fv(uniOffset, 1, glm::value_ptr(_quantization.offset));
 }
 
-GLuint Mesh::storeToVBO(Mesh::Vertex* vertices, long size) {
+// Create, bind, and load data into a vertex buffer object
+GLuint Object::storeToVBO(const void* vertices, int size) {
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
+    _resources.push_back( ResourceManager::get().adopt(RESOURCE_BUFFER, vbo, size) );
     return vbo;
 }
 
 // Create, bind, and load data into a vertex buffer object
-GLuint Object::storeToVBO(GLfloat* positions, int sizeP, GLfloat* colors, int sizeC) {
+GLuint Object::storeToVBO(const void* positions, int sizeP, const void* colors, int sizeC) {
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -76,54 +115,104 @@ GLuint Object::storeToVBO(GLfloat* positions, int sizeP, GLfloat* colors, int si
                     sizeP,            // offset = sizeof previous data entered
                     sizeC,            // size
                     colors);          // data
+    _resources.push_back( ResourceManager::get().adopt(RESOURCE_BUFFER, vbo, sizeP + sizeC) );
     return vbo;
 }
 
 // Create, bind, and load data into an element buffer object
-GLuint Object::storeToEBO(GLuint* indices, int size) {
+GLuint Object::storeToEBO(const void* indices, int size) {
     GLuint ebo;
     glGenBuffers(1, &ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, indices, GL_STATIC_DRAW);
+    _resources.push_back( ResourceManager::get().adopt(RESOURCE_BUFFER, ebo, size) );
     return ebo;
 }
 
-// Texture cache
-std::unordered_map<std::string, GLuint> textureCache;
+static GLenum sizedFormat(int channels) {
+    switch (channels) {
+        case 1: return GL_R8;
+        case 2: return GL_RG8;
+        case 4: return GL_RGBA8;
+        default: return GL_RGB8;
+    }
+}
+
+// Approximate GPU footprint of a mip chain (drivers generally pad RGB out to RGBA)
+static size_t chainBytes(const MipChain& chain) {
+    size_t bytes = 0;
+    int bpp = (chain.channels == 3) ? 4 : chain.channels;
+    for (auto& level : chain.levels)
+        bytes += level.width * level.height * bpp;
+    return bytes;
+}
+
+static GLenum pixelFormat(int channels) {
+    switch (channels) {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 4: return GL_RGBA;
+        default: return GL_RGB;
+    }
+}
+
+// Allocate immutable storage for every level up front (if supported), then fill each level in
+// (internalFormat defaults to the chain's own - cube map faces all have to share one)
+static void uploadMipChain(GLenum target, GLenum storageTarget, const MipChain& chain, bool allocate, GLenum internalFormat = 0) {
+    GLenum format = pixelFormat(chain.channels);
+    if (!internalFormat) internalFormat = sizedFormat(chain.channels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);      // levels are tightly packed
+
+    if (GLAD_GL_ARB_texture_storage) {
+        if (allocate)
+            glTexStorage2D(storageTarget, chain.levels.size(), internalFormat, chain.width(), chain.height());
+        for (int i = 0; i < chain.levels.size(); i++) {
+            auto& level = chain.levels[i];
+            glTexSubImage2D(target, i, 0, 0, level.width, level.height, format, GL_UNSIGNED_BYTE, level.data.data());
+        }
+    } else {
+        for (int i = 0; i < chain.levels.size(); i++) {
+            auto& level = chain.levels[i];
+            glTexImage2D(target, i, internalFormat, level.width, level.height, 0,
+                         format, GL_UNSIGNED_BYTE, level.data.data());
+        }
+        glTexParameteri(storageTarget, GL_TEXTURE_MAX_LEVEL, chain.levels.size() - 1);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
 
 // Create, bind, and load data into a 2D texture object
 GLuint Object::storeTex(std::string path, GLenum wrapping) {
 
-    // Check if this particular texture has already been loaded & return its ID if so
-    if (textureCache[path]) {
+    // Check if this texture has already been loaded with the same sampler state & share it if so
+    SamplerState sampler(wrapping);
+    std::string key = ResourceManager::textureKey(path, sampler);
+    ResourceHandle cached = ResourceManager::get().acquire(key);
+    if (cached) {
         if (DEBUG) std::cout << "Skipping loading of " << path << ": returning cached version" << std::endl;
-        return textureCache[path];
+        _resources.push_back(cached);
+        return ResourceManager::get().id(cached);
     }
 
     GLuint tex;
     glGenTextures(1, &tex);
-    textureCache[path] = tex;
-
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
-    if (data)  {
-        GLenum format = GL_RGB;
-        if (nrChannels == 1)        format = GL_RED;
-        else if (nrChannels == 4)   format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    // The mip chain is generated offline (& cached on disk), so there's no glGenerateMipmap here
+    MipChain chain = loadMipChain(path);
+    if (chain.valid())  {
+        uploadMipChain(GL_TEXTURE_2D, GL_TEXTURE_2D, chain, true);
         if (DEBUG) std::cout << path << " loaded" << std::endl;
 
     } else std::cerr << path << " failed to load" << std::endl;
 
-    stbi_image_free(data);
+    _resources.push_back( ResourceManager::get().adopt(RESOURCE_TEXTURE, tex, chain.valid() ? chainBytes(chain) : 0, key) );
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapping);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapping);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrap);
 
     if (wrapping == GL_CLAMP_TO_BORDER) {
         // Specify a border color
@@ -134,32 +223,190 @@ GLuint Object::storeTex(std::string path, GLenum wrapping) {
     return tex;
 }
 
+// Where each texture of a previously packed set went, so the arrays can be shared by later calls
+struct PackedLayout {
+    std::vector<std::string> arrayKeys;
+    std::vector<PackedImage> images;
+};
+static std::unordered_map<std::string, PackedLayout> packedLayouts;
+
+// The key a set of textures is packed under
+static std::string packedSetKey(const std::vector<std::string>& paths, const SamplerState& sampler) {
+    std::string setKey = "array:";
+    for (auto& path : paths) setKey += path + "|";
+    return ResourceManager::textureKey(setKey, sampler);
+}
+
+// Whether every array of a previously packed set is still cached
+static bool packedSetCached(const std::string& setKey) {
+    auto layout = packedLayouts.find(setKey);
+    if (layout == packedLayouts.end() || layout->second.arrayKeys.empty()) return false;
+    for (auto& key : layout->second.arrayKeys)
+        if (!ResourceManager::get().contains(key)) return false;
+    return true;
+}
+
+// Start decoding & filtering textures on background threads so that storeTexArrays only has to upload them.
+// A set that's already packed isn't loaded again, so nothing is prefetched for it (the chains would never be taken)
+void Object::prefetchTextures(const std::vector<std::string>& paths, GLenum wrapping) {
+    if (!packedSetCached(packedSetKey(paths, SamplerState(wrapping)))) prefetchMipChains(paths);
+}
+
+// Create texture arrays holding every texture in the list (see TexturePacker.h for how they're grouped)
+// & return where each texture ended up. Textures that fail to load get an empty slot
+std::vector<TextureSlot> Object::storeTexArrays(const std::vector<std::string>& paths, GLenum wrapping) {
+    SamplerState sampler(wrapping);
+    std::string setKey = packedSetKey(paths, sampler);
+    bool cached = packedSetCached(setKey);
+    PackedLayout& layout = packedLayouts[setKey];
+
+    // One reference per array this object uses
+    std::vector<ResourceHandle> handles;
+    if (cached) {
+        if (DEBUG) std::cout << "Skipping packing of " << paths.size() << " textures: returning cached arrays" << std::endl;
+        for (auto& key : layout.arrayKeys)
+            handles.push_back(ResourceManager::get().acquire(key));
+    } else {
+        prefetchMipChains(paths);
+        std::vector<MipChain> chains;
+        for (auto& path : paths) {
+            chains.push_back(loadMipChain(path));
+            if (!chains.back().valid()) std::cerr << path << " failed to load" << std::endl;
+        }
+
+        // Repeating textures can't go into atlases: the wrapping would sample the neighbouring images
+        bool allowAtlas = (wrapping != GL_REPEAT && wrapping != GL_MIRRORED_REPEAT);
+        PackedTextures packed = packTextures(chains, allowAtlas);
+        layout.images = packed.images;
+        layout.arrayKeys.clear();
+
+        for (int a = 0; a < packed.arrays.size(); a++) {
+            PackedArray& array = packed.arrays[a];
+            const MipChain& first = array.layers[0];
+            GLenum format = pixelFormat(array.channels);
+
+            GLuint tex;
+            glGenTextures(1, &tex);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+            int numLevels = first.levels.size();
+            if (GLAD_GL_ARB_texture_storage) {
+                glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, sizedFormat(array.channels),
+                               first.width(), first.height(), array.layers.size());
+            } else {
+                for (int i = 0; i < numLevels; i++)
+                    glTexImage3D(GL_TEXTURE_2D_ARRAY, i, sizedFormat(array.channels), first.levels[i].width,
+                                 first.levels[i].height, array.layers.size(), 0, format, GL_UNSIGNED_BYTE, nullptr);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+            }
+
+            size_t bytes = 0;
+            for (int l = 0; l < array.layers.size(); l++) {
+                for (int i = 0; i < numLevels; i++) {
+                    auto& level = array.layers[l].levels[i];
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, l, level.width, level.height, 1,
+                                    format, GL_UNSIGNED_BYTE, level.data.data());
+                }
+                bytes += chainBytes(array.layers[l]);
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+            // Atlas pages are padded, so clamping at the page's edges is all they need
+            GLenum wrap = array.atlas ? GL_CLAMP_TO_EDGE : sampler.wrap;
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+            if (wrap == GL_CLAMP_TO_BORDER) {
+                float borderColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };   // black
+                glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+            }
+
+            std::string key = setKey + "#" + std::to_string(a);
+            handles.push_back( ResourceManager::get().adopt(RESOURCE_TEXTURE, tex, bytes, key) );
+            layout.arrayKeys.push_back(key);
+
+            if (DEBUG) std::cout << "Packed " << array.layers.size() << (array.atlas ? " atlas page(s)" : " texture(s)")
+                                 << " of " << first.width() << "x" << first.height() << " into one array" << std::endl;
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    std::vector<GLuint> arrays;
+    for (auto handle : handles) {
+        _resources.push_back(handle);
+        arrays.push_back(ResourceManager::get().id(handle));
+    }
+
+    std::vector<TextureSlot> slots;
+    for (auto& image : layout.images) {
+        TextureSlot slot = { 0, 0.0f, glm::vec4(1.0f, 1.0f, 0.0f, 0.0f) };
+        if (image.array >= 0) {
+            slot.texture = arrays[image.array];
+            slot.layer = image.layer;
+            slot.uvRect = glm::vec4(image.uvRect[0], image.uvRect[1], image.uvRect[2], image.uvRect[3]);
+        }
+        slots.push_back(slot);
+    }
+    return slots;
+}
+
 // Create, bind, and load data into a texture cube map
 GLuint Object::storeCubeMap(std::vector<std::string>& faces) {
+    // Skyboxes using the same 6 faces share one cube map
+    std::string key = "cubemap";
+    for (auto& face : faces) key += "|" + face;
+    ResourceHandle cached = ResourceManager::get().acquire(key);
+    if (cached) {
+        if (DEBUG) std::cout << "Skipping loading of the cube map: returning cached version" << std::endl;
+        _resources.push_back(cached);
+        return ResourceManager::get().id(cached);
+    }
+
+    // Decode & filter all the faces at once on the texture threads
+    prefetchMipChains(faces);
+    std::vector<MipChain> chains;
+    for (auto& face : faces)
+        chains.push_back(loadMipChain(face));
+
+    // The storage is allocated for all 6 faces at once, so it takes the format of the face with the most
+    // channels (the others are converted on upload) & every face has to be the same size
+    int reference = -1;
+    for (int i = 0; i < chains.size(); i++) {
+        if (!chains[i].valid()) std::cerr << faces[i] << " failed to load." << std::endl;
+        else if (reference < 0 || chains[i].channels > chains[reference].channels) reference = i;
+    }
+    for (int i = 0; reference >= 0 && i < chains.size(); i++) {
+        if (chains[i].valid() && (chains[i].width() != chains[reference].width() || chains[i].height() != chains[reference].height()
+                                  || chains[i].levels.size() != chains[reference].levels.size())) {
+            std::cerr << faces[i] << " doesn't match the size of the other cube map faces." << std::endl;
+            chains[i] = MipChain();
+        }
+    }
+
     GLuint tex;
     glGenTextures(1, &tex);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
 
-    int width, height, nrChannels;
-    for (int i = 0; i < faces.size(); i++) {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)  {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                         0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        } else {
-            std::cerr << faces[i] << " failed to load." << std::endl;
-            stbi_image_free(data);
+    size_t bytes = 0;
+    if (reference >= 0) {
+        GLenum internalFormat = sizedFormat(chains[reference].channels);
+        uploadMipChain(GL_TEXTURE_CUBE_MAP_POSITIVE_X + reference, GL_TEXTURE_CUBE_MAP, chains[reference], true, internalFormat);
+        for (int i = 0; i < chains.size(); i++) {
+            if (i != reference && chains[i].valid())
+                uploadMipChain(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, GL_TEXTURE_CUBE_MAP, chains[i], false, internalFormat);
         }
+        bytes = chainBytes(chains[reference]) * faces.size();
     }
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
+    _resources.push_back( ResourceManager::get().adopt(RESOURCE_TEXTURE, tex, bytes, key) );
     return tex;
 }
-
@@ -13,14 +13,38 @@
 #include <iostream>
 
 #include "../Glad.h"
+#include "../Resources.h"
+#include "../VertexFormat.h"
+#include "../Frame.h"
+#include "../Transforms.h"
+#include "../Profiler.h"
+#include "../GpuProfiler.h"
 
 static bool DEBUG = false;
+static bool COMPACT_VERTICES = true;    // upload quantized vertex data (see VertexFormat.h)
+static bool RETAIN_GEOMETRY = false;    // keep the CPU copies of mesh data after upload (for collision/picking)
+
+// A texture's place in a shared GL_TEXTURE_2D_ARRAY (see TexturePacker.h)
+struct TextureSlot {
+    GLuint texture;
+    float layer;
+    glm::vec4 uvRect;       // scale (xy) & offset (zw) that map the texture's UVs into the layer
+};
+
+// How an object's materials combine with what's behind them (Scene::draw has a pass for each)
+enum BlendMode {
+    BLEND_OPAQUE,           // no blending
+    BLEND_ALPHA_TESTED,     // cut out where the texture is transparent (alpha-to-coverage with multisampling)
+    BLEND_BLENDED,          // alpha blended: drawn last, back to front
+};
 
 /*************************************************************
                    Abstract Base Classes
  *************************************************************/
 
 class Scene;
+class SnapshotWriter;
+class SnapshotReader;
 class Object {
 protected:
     GLuint _shaderProgram;
@@ -29,42 +53,60 @@ protected:
     // Pointer to the scene in order to access the camera, light source, terrain, etc
     Scene* _scene;
 
-    // Buffer ID storage for clean-up purposes: individually references may also be kept
-    std::vector <GLuint> _bufferIDs;
-    std::vector <GLuint> _textureIDs;
+    // Handles to every buffer & texture this object holds a reference to (released on destruction):
+    // individual GL IDs may also be kept
+    std::vector <ResourceHandle> _resources;
 
-    // State information
-    std::chrono::time_point<std::chrono::high_resolution_clock> _start;
+    // How the vertex shader should decode the vertex data
+    bool _compact;
+    Quantization _quantization;
+
+    // State information (the position, size, rotation & bounds are in the scene's TransformStore, in this slot)
+    uint32_t _transform;
     bool _lit;
-    glm::vec3 _position;
-    float _size;
-    glm::vec3 _rotationAxis;
-    float _rotationSpeed;
+    bool _depthDrawn;   // by renderDepth this frame, so render only has to shade the GL_EQUAL fragments
+    BlendMode _blendMode;
 
     // Helpers
     GLuint initializeVAO();
-    GLuint storeToVBO(GLfloat*, int);
-    GLuint storeToVBO(GLfloat*, int, GLfloat*, int);
-    GLuint storeToEBO(GLuint*, int);
+    GLuint storeToVBO(const void*, int);
+    GLuint storeToVBO(const void*, int, const void*, int);
+    GLuint storeToEBO(const void*, int);
     GLuint storeTex(std::string, GLenum = GL_REPEAT);
     GLuint storeCubeMap(std::vector<std::string>&);
+    std::vector<TextureSlot> storeTexArrays(const std::vector<std::string>&, GLenum = GL_REPEAT);
+    static void prefetchTextures(const std::vector<std::string>&, GLenum = GL_REPEAT);    // for storeTexArrays
+    void setVertexFormatUniforms(GLuint program = 0);    // _shaderProgram by default
+    TransformStore& transforms();
 
 public:
     Object(GLuint, Scene*);
     virtual ~Object();
 
+    // Per-frame CPU work that doesn't touch GL (animation, culling & matrices), which the scene runs on its job
+    // system's threads before render: it may only write the object's own state
+    virtual void prepare() {};
+
     virtual void render() {};   // Can throw a std::runtime_error
 
+    // Depth pre-pass with the given position-only program (opaque objects only)
+    virtual void renderDepth(GLuint) {};
+
     /**** Modifiers ****/
-    virtual void isLit(bool b) { _lit = b; };
+    virtual void isLit(bool);    // Switches to the shader variant with (or without) lighting
 
     // Sets position relative to the terrain
     virtual void setPosition(glm::vec3);    // Can throw a std::runtime_error exception if terrain isn't set
 
-    virtual void setSize(float s) { _size = s; };
-    virtual void setRotation(glm::vec3 axis) { _rotationAxis = axis; _rotationSpeed = 0; };
-    virtual void setRotation(glm::vec3 axis, float speed) { _rotationAxis = axis; _rotationSpeed = speed; };
+    virtual void setSize(float);
+    virtual void setRotation(glm::vec3 axis);
+    virtual void setRotation(glm::vec3 axis, float speed);
     // Note: Have to define 2 versions of setRotation bc can't set default arguments on virtual functions
+
+    /**** Accessors ****/
+    glm::vec3 position();
+    float size();
+    BlendMode blendMode() { return _blendMode; };
 };
 
 /*************************************************************
@@ -72,11 +114,21 @@ public:
  *************************************************************/
 
 class SkyBox : public Object {
+    GLuint _texture;    // the cube map (shared by skyboxes with the same faces)
+
+    // Pixels that passed the depth test the last time it was measured (debug only)
+    GLuint _samplesQuery;
+    bool _queryPending;
+    GLuint64 _samplesPassed;
+
 public:
     SkyBox(GLuint, Scene*);
-    ~SkyBox() final { glDeleteProgram(_shaderProgram); };
+    ~SkyBox() final;
 
-    void render() override;
+    void render() override;     // has to come after the opaque geometry
+
+    // Accessor
+    GLuint64 samplesPassed() { return _samplesPassed; };
 
     // Set helpful error messages for base class modifiers that don't make sense
     void isLit(bool) override                   { std::cerr << "Error: can't change skybox lighting\n"; };
@@ -88,18 +140,18 @@ public:
 
 
 class LightSource : public Object {
+    GLuint _vbo;
     glm::vec3 _onColor;
     glm::vec3 _color;
     bool _changed;
 
 public:
     LightSource(GLuint, Scene*, glm::vec3, glm::vec3);
-    ~LightSource() final { glDeleteProgram(_shaderProgram); };
 
     void render() override;
 
     // Accessors
-    glm::vec3 Position() { return _position; };
+    glm::vec3 Position() { return position(); };
     glm::vec3 Color() { return _color; };
 
     // Modifiers
@@ -120,20 +172,28 @@ class Terrain : public Object {
     int _numIndices;
 
     int _vertexCount;       // number of vertices along each side
-    sf::Image _heightMap;   // height map for this
+
+    // Where the terrain was placed: the simulation thread's collision queries read this copy rather than the
+    // transform store, which the render thread may grow (& move) while they run
+    glm::vec3 _origin;
 
     // Calculate these at initialization
     std::vector< std::vector<float> > _heights;
     std::vector< std::vector<glm::vec3> > _normals;
+    std::vector<GLuint> _vertexRemap;      // grid vertex -> vertex buffer position
+
+    void build(std::string);
+    bool restore(std::string);     // from the scene snapshot
+    void upload(const void*, int, const void*, int, const GLuint*);
 
     float barryCentric(glm::vec3, glm::vec3, glm::vec3, glm::vec2);
     void unbind();
 
 public:
     Terrain(GLuint, Scene*, std::string);
-    ~Terrain() final { glDeleteProgram(_shaderProgram); };
 
     void render() override;
+    void renderDepth(GLuint) override;
 
     // Accessor
     float getSize() { return SIZE; };
@@ -142,8 +202,11 @@ public:
 
     void set2DTexture(std::string);
 
-    // Sets the position of the terrain in absolute terms
-    void setPosition(glm::vec3 p) override { _position = p; };
+    // Sets the position of the terrain in absolute terms (before the simulation starts, see _origin)
+    void setPosition(glm::vec3 p) override {
+        _origin = p;
+        transforms().setPosition(_transform, p);
+    };
 
     // Base class modifiers that don't make sense
     void setSize(float) override                { std::cerr << "Error: terrain size is a compile-time constant\n"; };
@@ -161,18 +224,22 @@ protected:
     int _texture;
     int _numElements;
     bool _usesIndices;
+    glm::mat4 _model;       // as of prepare
 
     void unbind();
 
 public:
     Shape(GLuint, Scene*);
-    virtual ~Shape() { glDeleteProgram(_shaderProgram); };
 
+    void prepare() override;
     void render() override;
 };
 
 
 class Cube : public Shape {
+protected:
+    void storeTexCoords();
+
 public:
     Cube(GLuint, Scene*);
 
@@ -182,6 +249,39 @@ public:
 };
 
 
+// Textured cubes drawn with one texture bind & one instanced draw call: the textures are packed into
+// a shared texture array (& atlas), and each cube's transform, layer & UV rectangle are per-instance data
+class CubeBatch : public Cube {
+    struct Instance {
+        std::string texture;
+        uint32_t transform;     // slot in the scene's TransformStore
+        TextureSlot slot;
+    };
+    std::vector<Instance> _instances;
+    GLfloat* _instanceData;     // model matrix, UV rectangle & layer for each instance (in the frame arena)
+    GLuint _instanceVBO;
+
+    void setInstancePointers(int first);
+
+public:
+    CubeBatch(GLuint, Scene*);
+    ~CubeBatch() override;
+
+    // Position is relative to the terrain; a rotation speed of 0 makes the cube face the axis
+    void addCube(std::string texture, glm::vec3 position, float size, glm::vec3 axis, float speed = 0.0f);
+    void build();   // packs the textures (call once every cube has been added)
+
+    void prepare() override;    // fills in the instance data, in parallel
+    void render() override;
+
+    // The cubes are placed individually
+    void setPosition(glm::vec3) override        { std::cerr << "Error: position cubes with addCube\n"; };
+    void setSize(float) override                { std::cerr << "Error: size cubes with addCube\n"; };
+    void setRotation(glm::vec3) override        { std::cerr << "Error: rotate cubes with addCube\n"; };
+    void setRotation(glm::vec3, float) override { std::cerr << "Error: rotate cubes with addCube\n"; };
+};
+
+
 class Square : public Shape {
 public:
     Square(GLuint, Scene*);
@@ -201,24 +301,77 @@ public:     // Forward declarations
     struct Texture;
 
 private:
+    /********* Configurable settings *********/
+    static const int MAX_LODS = 4;
+    const float LOD_TRIANGLE_RATIOS[MAX_LODS] = { 1.0f, 0.5f, 0.25f, 0.1f };   // of the full detail triangle count
+    const float LOD_ERRORS[MAX_LODS] = { 0.0f, 0.01f, 0.03f, 0.08f };          // relative to the mesh's radius
+    const float LOD_PIXEL_ERROR = 1.0f;     // use the coarsest level whose error covers less than this many pixels
+    const float LOD_HYSTERESIS = 0.3f;      // fraction of LOD_PIXEL_ERROR the error must pass by before switching
+    const float ALPHA_CUTOFF = 0.5f;        // alpha-tested texels below this alpha are discarded...
+    const float COVERAGE_CUTOFF = 0.05f;    // ...or only these, when alpha-to-coverage fades the rest out
+    /*****************************************/
+
+    // Each level of detail is a range of the (shared) index buffer
+    struct Lod {
+        unsigned int offset;
+        unsigned int count;
+        float error;        // max distance from the full detail surface
+    };
+
     std::vector<Vertex> _vertices;
     std::vector<unsigned int> _indices;
     std::vector<Texture> _textures;
-
-    bool _blend;
-
-    // Overridden version for this class only (defn in Object.cpp)
-    GLuint storeToVBO(Mesh::Vertex*, long);
+    std::vector<Lod> _lods;
+    // _vertices & _indices are emptied after upload unless RETAIN_GEOMETRY is set
+
+    size_t _vertexCount;
+    size_t _vertexBytes;
+    GLenum _indexType;      // GL_UNSIGNED_SHORT whenever every vertex can be addressed with 16 bits
+    size_t _indexBytes;
+
+    // Bounding sphere (model space)
+    glm::vec3 _center;
+    float _radius;
+    int _currentLod;
+
+    // Picked once per frame by prepare, so the depth pre-pass & the shading pass draw exactly the same thing
+    glm::mat4 _model;
+    glm::mat4 _mvp;
+    int _lod;
+    bool _visible;      // the bounding sphere is in the view frustum
+
+    void generateLods();
+    int selectLod();
+    void setTextures(std::vector<Texture>&&);
+    void locateUniforms();
+    void upload(const void*, const void*);
     void unbind();
 
 public:
     Mesh(GLuint, Scene*);
 
+    void prepare() override;
     void render() override;
+    void renderDepth(GLuint) override;     // only if it's opaque
 
     // Modifiers
-    void addData(std::vector<Vertex>, std::vector<unsigned int>, std::vector<Texture>);
-    void setBlend(bool b) { _blend = b; };
+    // (records what it uploads for the scene snapshot if given a writer - see Snapshot.h)
+    void addData(std::vector<Vertex>&&, std::vector<unsigned int>&&, std::vector<Texture>&&, SnapshotWriter* = nullptr);
+    bool restore(SnapshotReader&);
+    void setBlendMode(BlendMode);
+    void isLit(bool) override;
+    void setTextureSlots(const std::unordered_map<std::string, TextureSlot>&);     // by texture path
+
+    // Accessors
+    size_t vertexCount() { return _vertexCount; };
+    size_t vertexBytes() { return _vertexBytes; };
+    size_t indexCount() { return _lods.empty() ? 0 : _lods[0].count; };     // at full detail
+    size_t indexBytes() { return _indexBytes; };                            // including the coarser levels of detail
+    size_t indexSize() { return (_indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint); };
+
+    // CPU copies of the geometry (only kept with RETAIN_GEOMETRY)
+    const std::vector<Vertex>& vertices() { return _vertices; };
+    const std::vector<unsigned int>& indices() { return _indices; };
 
     struct Vertex {
         glm::vec3 position;
@@ -228,7 +381,10 @@ public:
     struct Texture {
         std::string name;
         std::string path;
-        GLuint id;
+        GLuint id = 0;      // a GL_TEXTURE_2D_ARRAY shared by the model's materials (none if it failed to pack)
+        float layer = 0;
+        GLint samplerLocation = -1;     // the uniforms of the name & its layer, in the mesh's program
+        GLint layerLocation = -1;
     };
 };
 
@@ -237,6 +393,12 @@ public:
 class Model : public Object {
     std::vector<Mesh*> _meshes;
     std::string _pathRoot;
+    const char* _profileName;   // the model's file, for its GPU zone
+    size_t _importedVertices;   // before welding
+    SnapshotWriter* _recording; // where processMesh records the meshes while importing (if the scene snapshot is)
+
+    bool import(std::string, GLuint, Scene*, std::vector<std::string>&);
+    bool restore(std::string, GLuint, Scene*, std::vector<std::string>&);
 
     // Processing helpers
     void processNode(aiNode*, const aiScene*, GLuint, Scene*);
@@ -247,10 +409,12 @@ public:
     Model(std::string, GLuint, Scene*);
     ~Model() final;
 
+    void prepare() override;
     void render() override;
+    void renderDepth(GLuint) override;
 
     // Modifiers
-    void setBlend(bool);
+    void setBlendMode(BlendMode);
     void isLit(bool) override;
     void setPosition(glm::vec3) override;
     void setSize(float) override;
@@ -1,5 +1,6 @@
 #include "Object.h"
 #include "../Scene.h"
+#include "../Shaders.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -8,9 +9,16 @@
 using namespace glm;
 
 // Note: don't unbind in this ctor because the child class constructors still haven't been called
-Shape::Shape(GLuint s, Scene* sc) : Object(s, sc), _texture(0) {}
+Shape::Shape(GLuint s, Scene* sc) : Object(s, sc), _texture(0), _model(1.0f) {}
+
+// The model matrix (scale -> rotate -> translate) as of the scene's last transform update
+void Shape::prepare() {
+    _model = transforms().model(_transform);
+}
 
 void Shape::render() {
+    PROFILE_ZONE("Shape::render");
+    PROFILE_GPU_ZONE("Shape");
     // Bind the shapes's data
     glBindVertexArray(_vao);
     glUseProgram(_shaderProgram);
@@ -19,30 +27,11 @@ void Shape::render() {
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, _texture); // this binding is global, so needs to be set for each draw
 
-    mat4 rot(1.0f);
-    if (_rotationAxis != vec3(0.0f)) {
-        // Speed is set -> rotation as a factor of time in the specified axis
-        if (_rotationSpeed != 0) {
-            auto now = std::chrono::high_resolution_clock::now();
-            float timeDiff = std::chrono::duration_cast<std::chrono::duration<float>>(now - _start).count();
-            rot = rotate(mat4(1.0f), timeDiff * _rotationSpeed * radians(360.f), _rotationAxis);
-        }
-
-        // Speed is not set -> static rotation so object simply faces the given axis
-        else {
-            vec3 forward = vec3(0.0f, 0.0f, 1.0f);
-            float angle = acos( dot(forward, _rotationAxis) / (length(forward) * length(_rotationAxis)) );
-            rot = rotate(mat4(1.0f), angle, _rotationAxis);
-        }
-    }
-
-    // Generate the model matrix (scale -> rotate -> translate)
-    mat4 model = translate(mat4(1.0f), _position) * rot * scale(mat4(1.0f), vec3(_size, _size, _size));
-
     // Pass the MVP matrix into our shader
-    mat4 MVP = _scene->camera()->ProjMatrix() * _scene->camera()->ViewMatrix() * model;
+    mat4 MVP = _scene->viewProjection() * _model;
     GLint uniTransform = glGetUniformLocation(_shaderProgram, "MVP");
     glUniformMatrix4fv(uniTransform, 1, GL_FALSE, value_ptr(MVP));
+    setVertexFormatUniforms();
 
     // Set the appropriate lighting data
     if (_lit) {
@@ -53,20 +42,17 @@ void Shape::render() {
         glUniform3fv(uniLightPos, 1, value_ptr(_scene->lightSource()->Position()));
 
         GLint uniModel = glGetUniformLocation(_shaderProgram, "Model");
-        glUniformMatrix4fv(uniModel, 1, GL_FALSE, value_ptr(model));
+        glUniformMatrix4fv(uniModel, 1, GL_FALSE, value_ptr(_model));
 
         GLint uniPosn = glGetUniformLocation(_shaderProgram, "viewPos");
-        glUniform3fv(uniPosn, 1, value_ptr(_scene->camera()->Position()));
-
-    } else {
-        // Set lightColor = 0 so the fragment shader knows not to try to light the shape
-        GLint uniLightCol = glGetUniformLocation(_shaderProgram, "lightColor");
-        glUniform3fv(uniLightCol, 1, value_ptr(vec3(0.0f)));
+        glUniform3fv(uniPosn, 1, value_ptr(_scene->frame().cameraPosition));
     }
 
     // Draw the shapes
+    beginShaderQuery(_shaderProgram);
     if (_usesIndices)   glDrawElements(GL_TRIANGLES, _numElements, GL_UNSIGNED_INT, nullptr);
     else                glDrawArrays(GL_TRIANGLES, 0, _numElements);
+    endShaderQuery();
 
     unbind();
 };
@@ -1,46 +1,17 @@
 #include "Object.h"
 #include "../Scene.h"
+#include "../Shaders.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 using namespace glm;
 
-SkyBox::SkyBox(GLuint s, Scene* sc) : Object(s, sc) {
-
-    // Vertex data simply represents a large cube
-    GLfloat points[] = {
-            1.0f,  1.0f, 1.0f,
-            1.0f,  1.0f, -1.0f,
-            1.0f,  -1.0f, 1.0f,
-            1.0f,  -1.0f, -1.0f,
-            -1.0f,  1.0f, 1.0f,
-            -1.0f,  1.0f, -1.0f,
-            -1.0f,  -1.0f, 1.0f,
-            -1.0f,  -1.0f, -1.0f
-    };
-    _bufferIDs.push_back( storeToVBO(points, sizeof(points)) );
-
-    GLuint indices[] = {
-            5, 7, 3,
-            3, 1, 5,
-
-            6, 7, 5,
-            5, 4, 6,
-
-            3, 2, 0,
-            0, 1, 3,
+SkyBox::SkyBox(GLuint s, Scene* sc) : Object(s, sc), _queryPending(false), _samplesPassed(0) {
+    auto start = std::chrono::high_resolution_clock::now();
 
-            6, 4, 0,
-            0, 2, 6,
-
-            5, 1, 0,
-            0, 4, 5,
-
-            7, 6, 3,
-            3, 6, 2
-    };
-    _bufferIDs.push_back( storeToEBO(indices, sizeof(indices)) );
+    // There's no vertex data: the vertex shader generates a triangle covering the screen from gl_VertexID
+    // (a VAO still has to be bound to draw in the core profile)
 
     // Load the cubemap textures
     std::vector<std::string> faces {
@@ -51,38 +22,67 @@ SkyBox::SkyBox(GLuint s, Scene* sc) : Object(s, sc) {
             "assets/skybox/front.jpg",
             "assets/skybox/back.jpg"
     };
-    _textureIDs.push_back( storeCubeMap(faces) );
+    _texture = storeCubeMap(faces);
 
-    // Tell OpenGL where to find/how to interpret the vertex data
     glUseProgram(_shaderProgram);
-    GLint posAttrib = glGetAttribLocation(_shaderProgram, "vPosition");
-    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(posAttrib);
-
     GLint sampleCube = glGetUniformLocation(_shaderProgram, "skybox");
     glUniform1i(sampleCube, 0);
+
+    // Counts the pixels the skybox actually shades
+    glGenQueries(1, &_samplesQuery);
+
+    if (DEBUG) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        std::cout << "Created the skybox in " << elapsed.count() << "ms" << std::endl;
+    }
 };
 
+SkyBox::~SkyBox() {
+    glDeleteQueries(1, &_samplesQuery);
+}
 
+// Drawn after the opaque geometry, on the far plane: the depth test rejects every pixel something covers
 void SkyBox::render() {
+    PROFILE_ZONE("SkyBox::render");
+    PROFILE_GPU_ZONE("SkyBox");
     // Bind the skybox's data
     glBindVertexArray(_vao);
     glUseProgram(_shaderProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _texture);
 
-    // Turn off the depth test (so that it always gets overwritten)
+    // Depth 1.0 only passes where nothing has been drawn (& there's no need to write it)
+    glDepthFunc(GL_LEQUAL);
     glDepthMask(GL_FALSE);
 
-    // Remove the translation component of the view matrix
-    mat4 view = mat4(mat3(_scene->camera()->ViewMatrix()));
-
-    // Pass the MVP matrix into our shader
-    mat4 model = mat4(1.0f);
-    mat4 MVP = _scene->camera()->ProjMatrix() * view * model;
-    GLint uniTransform = glGetUniformLocation(_shaderProgram, "MVP");
-    glUniformMatrix4fv(uniTransform, 1, GL_FALSE, value_ptr(MVP));
-
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
+    // The view direction of each pixel comes from unprojecting it with the translation-free view matrix
+    mat4 view = mat4(mat3(_scene->frame().view));
+    mat4 inverseVP = inverse(_scene->frame().projection * view);
+    GLint uniInverse = glGetUniformLocation(_shaderProgram, "inverseViewProj");
+    glUniformMatrix4fv(uniInverse, 1, GL_FALSE, value_ptr(inverseVP));
+
+    // Only one query is in flight at a time, so reading it back never stalls
+    if (_queryPending) {
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(_samplesQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            glGetQueryObjectui64v(_samplesQuery, GL_QUERY_RESULT, &_samplesPassed);
+            _queryPending = false;
+        }
+    }
+    bool measure = DEBUG && !_queryPending;
+    if (measure) glBeginQuery(GL_SAMPLES_PASSED, _samplesQuery);
+
+    beginShaderQuery(_shaderProgram);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    endShaderQuery();
+
+    if (measure) {
+        glEndQuery(GL_SAMPLES_PASSED);
+        _queryPending = true;
+    }
 
     // Reset the depth test
     glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
 }
@@ -20,13 +20,13 @@ Square::Square(GLuint s, Scene* sc) : Shape(s, sc) {
             0.0f, -1.0f,  0.0f,
             0.0f, -1.0f,  0.0f,
     };
-    _bufferIDs.push_back( storeToVBO(positions, sizeof(positions), normals, sizeof(normals)) );
+    storeToVBO(positions, sizeof(positions), normals, sizeof(normals));
 
     GLuint indices[] = {
             0, 1, 3,
             1, 2, 3
     };
-    _bufferIDs.push_back( storeToEBO(indices, sizeof(indices)) );
+    storeToEBO(indices, sizeof(indices));
 
     GLint posAttrib = glGetAttribLocation(_shaderProgram, "vPosition");
     glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
@@ -50,10 +50,9 @@ void Square::set2DTexture(std::string path) {
             0.0f, 1.0f,
             0.0f, 0.0f,
     };
-    _bufferIDs.push_back( storeToVBO(textcoords, sizeof(textcoords)) );
+    storeToVBO(textcoords, sizeof(textcoords));
 
     _texture = storeTex(path, GL_REPEAT);
-    _textureIDs.push_back( _texture );
 
     GLint colAttrib = glGetAttribLocation(_shaderProgram, "vTexture");
     glVertexAttribPointer(colAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
@@ -1,19 +1,35 @@
 #include "Object.h"
 #include "../Scene.h"
+#include "../Shaders.h"
+#include "../MeshOptimizer.h"
+#include "../Assets.h"
+#include "../Snapshot.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstring>
 
 using namespace glm;
 
-Terrain::Terrain(GLuint s, Scene* sc, std::string path) : Object(s, sc) {
+Terrain::Terrain(GLuint s, Scene* sc, std::string path) : Object(s, sc), _origin(0.0f) {
+    PROFILE_ZONE("Terrain::Terrain");
     glUseProgram(_shaderProgram);
+    if (!restore(path)) build(path);
+    unbind();
+};
+
+// Generates the terrain from its height map
+void Terrain::build(std::string path) {
+    PROFILE_ZONE("Terrain::build");
+    snapshotDepends(path);
 
     // Load the height map image
-    _heightMap = sf::Image();
-    if (!_heightMap.loadFromFile(path)) std::cerr << "Error: error loading heightmap " << path << std::endl;
+    // (only needed while the heights are extracted - the heights & normals are kept for collisions)
+    AssetData file = readAsset(path);
+    sf::Image heightMap;
+    if (!file.valid() || !heightMap.loadFromMemory(file.data(), file.size())) std::cerr << "Error: error loading heightmap " << path << std::endl;
 
-    int heightMapSize = _heightMap.getSize().x;
+    int heightMapSize = heightMap.getSize().x;
 
     // Calculate the heights and normals for each pixel of this map
     _heights.resize(heightMapSize);
@@ -24,7 +40,7 @@ Terrain::Terrain(GLuint s, Scene* sc, std::string path) : Object(s, sc) {
     }
     for (int i=0; i<heightMapSize; i++) {
         for (int j=0; j<heightMapSize; j++) {
-            float rawHeight = _heightMap.getPixel(i, j).r;  // Gives a # from 0-256
+            float rawHeight = heightMap.getPixel(i, j).r;  // Gives a # from 0-256
             float height = (rawHeight - 128) / 128;         // Get the range to be (-1)-1
             _heights[i][j] =  height * MAX_HEIGHT;
         }
@@ -46,8 +62,8 @@ Terrain::Terrain(GLuint s, Scene* sc, std::string path) : Object(s, sc) {
     int totalVtcs = _vertexCount * _vertexCount;
 
     // Note that the square we will generate has its TOP LEFT CORNER at (0,0,0)
-    GLfloat* positions = new GLfloat[totalVtcs * 3];
-    GLfloat* normals = new GLfloat[totalVtcs * 3];
+    std::vector<vec3> positions(totalVtcs);
+    std::vector<vec3> normals(totalVtcs);
     int vtxCount = 0;
     for (int i=0; i<_vertexCount; i++) {
         for (int j=0; j<_vertexCount; j++) {
@@ -55,23 +71,16 @@ Terrain::Terrain(GLuint s, Scene* sc, std::string path) : Object(s, sc) {
 
             GLfloat x = (float) i * sideLength;
             GLfloat z = (float) j * sideLength;
-            positions[vtxCount*3] = x;
-            positions[vtxCount*3+1] = _heights[i][j];
-            positions[vtxCount*3+2] = z;
-
-            vec3 norm = _normals[i][j];
-            normals[vtxCount*3] = norm.x;
-            normals[vtxCount*3+1] = norm.y;
-            normals[vtxCount*3+2] = norm.z;
+            positions[vtxCount] = vec3(x, _heights[i][j], z);
+            normals[vtxCount] = _normals[i][j];
 
             vtxCount++;
         }
     }
-    _bufferIDs.push_back( storeToVBO(positions, sizeof(GLfloat) * totalVtcs * 3, normals, sizeof(GLfloat) * totalVtcs * 3) );
 
     // Generate the indices for drawing these triangles
     _numIndices = 6 * (_vertexCount-1) * (_vertexCount -1);
-    GLuint* indices = new GLuint[_numIndices];
+    std::vector<GLuint> indices(_numIndices);
     int indexCount = 0;
     for (int i=0; i<_vertexCount-1; i++) {
         for (int j=0; j<_vertexCount-1; j++) {
@@ -90,20 +99,119 @@ Terrain::Terrain(GLuint s, Scene* sc, std::string path) : Object(s, sc) {
             indices[indexCount++] = bottomRight;
         }
     }
-    _bufferIDs.push_back( storeToEBO(indices, sizeof(GLuint) * _numIndices) );
 
-    GLint posAttrib = glGetAttribLocation(_shaderProgram, "vPosition");
-    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(posAttrib);
+    // Row-major triangles thrash the vertex cache, so reorder them (the remap is kept for the texture coordinates)
+    _vertexRemap = optimizeMesh(indices, &positions[0].x, sizeof(vec3), totalVtcs, path);
+    remapVertices(positions, _vertexRemap);
+    remapVertices(normals, _vertexRemap);
+
+    std::vector<int16_t> packedPositions;
+    std::vector<uint32_t> packedNormals;
+    const void* positionData = &positions[0].x;
+    const void* normalData = &normals[0].x;
+    int sizeP = sizeof(GLfloat) * totalVtcs * 3;
+    int sizeN = sizeP;
+    _compact = COMPACT_VERTICES;
+    if (_compact) {
+        // 16-bit positions within the terrain's bounding box & 10:10:10:2 normals
+        _quantization = quantizationFor(&positions[0].x, totalVtcs, sizeof(vec3));
+
+        packedPositions.resize(totalVtcs * 4);
+        packedNormals.resize(totalVtcs);
+        for (int i=0; i<totalVtcs; i++) {
+            packPosition(positions[i], _quantization, &packedPositions[i * 4]);
+            packedNormals[i] = packNormal1010102(normals[i]);
+        }
+        positionData = &packedPositions[0];
+        normalData = &packedNormals[0];
+        sizeP = sizeof(int16_t) * totalVtcs * 4;
+        sizeN = sizeof(uint32_t) * totalVtcs;
+
+        if (DEBUG) std::cout << "Vertex data for " << path << ": " << (sizeP + sizeN) / 1024
+                             << "KB (" << sizeof(GLfloat) * totalVtcs * 6 / 1024 << "KB as floats)" << std::endl;
+    }
+    upload(positionData, sizeP, normalData, sizeN, &indices[0]);
+
+    if (snapshotRecording()) {
+        SnapshotWriter writer;
+        writer.write((int32_t) _vertexCount);
+        writer.write((int32_t) _numIndices);
+        writer.write((uint8_t) _compact);
+        writer.write(_quantization);
+        for (auto& column : _heights) writer.append(&column[0], sizeof(float) * _vertexCount);
+        for (auto& column : _normals) writer.append(&column[0], sizeof(vec3) * _vertexCount);
+        writer.append(&_vertexRemap[0], sizeof(GLuint) * totalVtcs);
+        writer.write((int32_t) sizeP);
+        writer.write((int32_t) sizeN);
+        writer.append(positionData, sizeP);
+        writer.append(normalData, sizeN);
+        writer.append(&indices[0], sizeof(GLuint) * _numIndices);
+        addSnapshot("terrain:" + path, std::move(writer));
+    }
+}
 
+// Loads the generated terrain from the scene snapshot, uploading the vertices straight out of it
+bool Terrain::restore(std::string path) {
+    PROFILE_ZONE("Terrain::restore");
+    SnapshotReader reader;
+    if (!findSnapshot("terrain:" + path, reader)) return false;
+
+    int vertexCount = reader.read<int32_t>();
+    int numIndices = reader.read<int32_t>();
+    bool compact = reader.read<uint8_t>();
+    Quantization quantization = reader.read<Quantization>();
+    if (vertexCount <= 1 || compact != COMPACT_VERTICES) return false;    // baked with other settings
+
+    int totalVtcs = vertexCount * vertexCount;
+    const unsigned char* heights = reader.view(sizeof(float) * totalVtcs);
+    const unsigned char* normals = reader.view(sizeof(vec3) * totalVtcs);
+    const unsigned char* remap = reader.view(sizeof(GLuint) * totalVtcs);
+    int sizeP = reader.read<int32_t>();
+    int sizeN = reader.read<int32_t>();
+    const unsigned char* positionData = reader.view(sizeP);
+    const unsigned char* normalData = reader.view(sizeN);
+    const unsigned char* indices = reader.view(sizeof(GLuint) * numIndices);
+    if (!reader.ok()) return false;
+
+    _vertexCount = vertexCount;
+    _numIndices = numIndices;
+    _compact = compact;
+    _quantization = quantization;
+    _heights.assign(vertexCount, std::vector<float>(vertexCount));
+    _normals.assign(vertexCount, std::vector<vec3>(vertexCount));
+    for (int i=0; i<vertexCount; i++) {
+        memcpy(&_heights[i][0], heights + sizeof(float) * vertexCount * i, sizeof(float) * vertexCount);
+        memcpy(&_normals[i][0], normals + sizeof(vec3) * vertexCount * i, sizeof(vec3) * vertexCount);
+    }
+    _vertexRemap.resize(totalVtcs);
+    memcpy(&_vertexRemap[0], remap, sizeof(GLuint) * totalVtcs);
+
+    upload(positionData, sizeP, normalData, sizeN, (const GLuint*) indices);
+    return true;
+}
+
+// Stores the vertex data in the formats _compact says they're in
+void Terrain::upload(const void* positions, int sizeP, const void* normals, int sizeN, const GLuint* indices) {
+    storeToVBO(positions, sizeP, normals, sizeN);
+
+    GLint posAttrib = glGetAttribLocation(_shaderProgram, "vPosition");
     GLint normAttrib = glGetAttribLocation(_shaderProgram, "vNormal");
-    glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)(sizeof(GLfloat) * totalVtcs * 3));
+    if (_compact) {
+        glVertexAttribPointer(posAttrib, 3, GL_SHORT, GL_TRUE, 4 * sizeof(int16_t), 0);
+        glVertexAttribPointer(normAttrib, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 0, (void*)(long)sizeP);
+    } else {
+        glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)(long)sizeP);
+    }
+    glEnableVertexAttribArray(posAttrib);
     glEnableVertexAttribArray(normAttrib);
 
-    unbind();
-};
+    storeToEBO(indices, sizeof(GLuint) * _numIndices);
+}
 
 void Terrain::render() {
+    PROFILE_ZONE("Terrain::render");
+    PROFILE_GPU_ZONE("Terrain");
     // Bind the terrain's data
     glBindVertexArray(_vao);
     glUseProgram(_shaderProgram);
@@ -113,12 +221,13 @@ void Terrain::render() {
     glBindTexture(GL_TEXTURE_2D, _texture);
 
     // The only transformation that applies to terrains is translation
-    mat4 model = translate(mat4(1.0f), _position);
+    mat4 model = translate(mat4(1.0f), position());
 
     // Pass the MVP matrix into our shader
-    mat4 MVP = _scene->camera()->ProjMatrix() * _scene->camera()->ViewMatrix() * model;
+    mat4 MVP = _scene->viewProjection() * model;
     GLint uniTransform = glGetUniformLocation(_shaderProgram, "MVP");
     glUniformMatrix4fv(uniTransform, 1, GL_FALSE, value_ptr(MVP));
+    setVertexFormatUniforms();
 
     // Set the appropriate lighting data
     if (_lit) {
@@ -132,16 +241,33 @@ void Terrain::render() {
         glUniformMatrix4fv(uniModel, 1, GL_FALSE, value_ptr(model));
 
         GLint uniPosn = glGetUniformLocation(_shaderProgram, "viewPos");
-        glUniform3fv(uniPosn, 1, value_ptr(_scene->camera()->Position()));
-
-    } else {
-        // Set lightColor = 0 so the fragment shader knows not to try to light the shape
-        GLint uniLightCol = glGetUniformLocation(_shaderProgram, "lightColor");
-        glUniform3fv(uniLightCol, 1, value_ptr(vec3(0.0f)));
+        glUniform3fv(uniPosn, 1, value_ptr(_scene->frame().cameraPosition));
     }
 
-    // Draw the terrain
+    // Draw the terrain (only the visible fragments if the depth is already there)
+    if (_depthDrawn) glDepthFunc(GL_EQUAL);
+    beginShaderQuery(_shaderProgram);
+    glDrawElements(GL_TRIANGLES, _numIndices, GL_UNSIGNED_INT, nullptr);
+    endShaderQuery();
+    if (_depthDrawn) glDepthFunc(GL_LESS);
+    _depthDrawn = false;
+
+    unbind();
+}
+
+void Terrain::renderDepth(GLuint program) {
+    PROFILE_ZONE("Terrain::renderDepth");
+    glBindVertexArray(_vao);
+    glUseProgram(program);
+
+    mat4 model = translate(mat4(1.0f), position());
+    mat4 MVP = _scene->viewProjection() * model;
+    GLint uniTransform = glGetUniformLocation(program, "MVP");
+    glUniformMatrix4fv(uniTransform, 1, GL_FALSE, value_ptr(MVP));
+    setVertexFormatUniforms(program);
+
     glDrawElements(GL_TRIANGLES, _numIndices, GL_UNSIGNED_INT, nullptr);
+    _depthDrawn = true;
 
     unbind();
 }
@@ -153,7 +279,7 @@ void Terrain::set2DTexture(std::string path) {
 
     // Dynamically determine the texture coordinates
     int totalVertices = _vertexCount * _vertexCount;
-    GLfloat* textureCoords = new GLfloat[totalVertices * 2];
+    std::vector<GLfloat> textureCoords(totalVertices * 2);
     int count = 0;
     for (int i=0; i<_vertexCount; i++) {
         for (int j=0; j<_vertexCount; j++) {
@@ -163,15 +289,16 @@ void Terrain::set2DTexture(std::string path) {
 
             GLfloat x = (float) j /  ((float)_vertexCount - 1);
             GLfloat y = (float) i / ((float)_vertexCount - 1);
-            textureCoords[count*2] = x * shrinkFactor;
-            textureCoords[count*2+1] = y * shrinkFactor;
+            GLuint vtx = _vertexRemap[count];    // the grid vertex's position in the optimized buffer
+            textureCoords[vtx*2] = x * shrinkFactor;
+            textureCoords[vtx*2+1] = y * shrinkFactor;
             count++;
         }
     }
-    _bufferIDs.push_back( storeToVBO(textureCoords, sizeof(GLfloat) * totalVertices * 2) );
+    // Note: these stay as floats even with compact vertices - they run up to SIZE/2, where half floats are too coarse
+    storeToVBO(&textureCoords[0], sizeof(GLfloat) * totalVertices * 2);
 
     _texture = storeTex(path, GL_REPEAT);
-    _textureIDs.push_back( _texture );
 
     GLint colAttrib = glGetAttribLocation(_shaderProgram, "vTexture");
     glVertexAttribPointer(colAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
@@ -194,8 +321,8 @@ float Terrain::barryCentric(vec3 p1, vec3 p2, vec3 p3, vec2 pos) {
 
 float Terrain::getHeightAt(float worldX, float worldZ) {
     // Map these x and z coordinates to coords relative to terrain
-    float terrainX = worldX - _position.x;
-    float terrainZ = worldZ - _position.z;
+    float terrainX = worldX - _origin.x;
+    float terrainZ = worldZ - _origin.z;
 
     // Terrain is just a grid of squares - find which square this terrain coord is in
     float gridSqSz = SIZE / float(_heights.size());
@@ -230,12 +357,12 @@ float Terrain::getHeightAt(float worldX, float worldZ) {
 
 // TODO: get precise normal at a point
 glm::vec3 Terrain::getNormalAt(int worldX, int worldZ) {
-    float terrainX = worldX - _position.x;
-    float terrainZ = worldZ - _position.z;
-    float gridSqSz = SIZE / _heightMap.getSize().x;
+    float terrainX = worldX - _origin.x;
+    float terrainZ = worldZ - _origin.z;
+    float gridSqSz = SIZE / _normals.size();
     int x = terrainX / gridSqSz;
     int z = terrainZ / gridSqSz;
-    if (x < 0 || z < 0 || x >= _heightMap.getSize().x || z >= _heightMap.getSize().y)
+    if (x < 0 || z < 0 || x >= _normals.size() || z >= _normals.size())
         return vec3(0.0f, 0.0f, 0.0f);
     return _normals[x][z];
 }
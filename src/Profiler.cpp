@@ -0,0 +1,171 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <sys/stat.h>
+
+using namespace std;
+
+/********* Configurable settings *********/
+static const uint64_t RING_SIZE = 1 << 16;      // zones kept per thread (a power of 2)
+static const uint64_t FRAME_RING_SIZE = 256;    // frame starts kept
+/*****************************************/
+
+struct Zone {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// A thread's zones, or a track's
+struct ProfileTrack {
+    string name;
+    int id;
+    atomic<uint64_t> head;      // zones recorded so far: the newest is at (head - 1) % RING_SIZE
+    Zone zones[RING_SIZE];
+};
+
+// Kept after their threads finish, so their zones can still be exported
+static mutex ringsLock;
+static vector<unique_ptr<ProfileTrack>> rings;
+static thread_local ProfileTrack* ring = nullptr;
+
+static mutex namesLock;
+static set<string> names;
+
+// The ticks & the steady clock when the program started, to convert the ticks to time by
+typedef chrono::steady_clock Clock;
+static const uint64_t startTicks = profileTicks();
+static const Clock::time_point startTime = Clock::now();
+
+static uint64_t frameStarts[FRAME_RING_SIZE];
+static atomic<uint64_t> frameCount(0);
+static uint64_t firstFrame = 0;
+
+ProfileTrack* profileTrack(const char* name) {
+    lock_guard<mutex> guard(ringsLock);
+    rings.emplace_back(new ProfileTrack());
+    ProfileTrack* track = rings.back().get();
+    track->name = name;
+    track->id = (int) rings.size();
+    track->head = 0;
+    return track;
+}
+
+void profileThread(const char* name) {
+    if (!ring) {
+        ring = profileTrack(name);
+        return;
+    }
+    lock_guard<mutex> guard(ringsLock);
+    ring->name = name;
+}
+
+void recordZone(ProfileTrack* track, const char* name, uint64_t start, uint64_t end) {
+    // Only one thread writes to a ring, so the slot is ours until head moves past it
+    uint64_t head = track->head.load(memory_order_relaxed);
+    track->zones[head & (RING_SIZE - 1)] = { name, start, end };
+    track->head.store(head + 1, memory_order_release);
+}
+
+void recordZone(const char* name, uint64_t start, uint64_t end) {
+    if (!ring) profileThread("Thread");
+    recordZone(ring, name, start, end);
+}
+
+const char* profileName(const string& name) {
+    lock_guard<mutex> guard(namesLock);
+    return names.insert(name).first->c_str();
+}
+
+void profileFrame() {
+    uint64_t now = profileTicks();
+    uint64_t count = frameCount.load(memory_order_relaxed);
+    if (count == 0) firstFrame = now;
+    frameStarts[count % FRAME_RING_SIZE] = now;
+    frameCount.store(count + 1, memory_order_release);
+}
+
+/*************************************************************
+                          Export
+ *************************************************************/
+
+double profileTickRate() {
+    uint64_t ticks = profileTicks();
+    double elapsed = chrono::duration<double, micro>(Clock::now() - startTime).count();
+    return (elapsed > 0) ? (ticks - startTicks) / elapsed : 1.0;
+}
+
+// The zones that started in [from, to) (ticks), in the trace event format
+static bool writeTrace(const string& path, uint64_t from, uint64_t to) {
+    string dir = path.substr(0, path.find_last_of('/'));
+    if (dir != path) mkdir(dir.c_str(), 0755);
+
+    ofstream out(path);
+    if (!out) return false;
+    out << fixed << setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]() -> ofstream& {
+        if (!first) out << ",\n";
+        first = false;
+        return out;
+    };
+
+    double rate = profileTickRate();
+    auto microseconds = [&](uint64_t ticks) { return (double) (ticks - min(ticks, startTicks)) / rate; };
+
+    lock_guard<mutex> guard(ringsLock);
+    vector<Zone> zones;
+    for (auto& it : rings) {
+        separator() << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << it->id
+                    << ",\"args\":{\"name\":\"" << it->name << "\"}}";
+
+        // Copy what the ring holds, & keep only what the thread can't have overwritten since (it may be recording)
+        uint64_t head = it->head.load(memory_order_acquire);
+        uint64_t oldest = head - min(head, RING_SIZE);
+        zones.clear();
+        for (uint64_t i = oldest; i < head; i++)
+            zones.push_back(it->zones[i & (RING_SIZE - 1)]);
+        uint64_t now = it->head.load(memory_order_acquire) + 1;      // counting the zone it may be writing
+        uint64_t valid = now - min(now, RING_SIZE);
+        size_t skip = (size_t) (max(valid, oldest) - oldest);
+
+        for (size_t i = skip; i < zones.size(); i++) {
+            const Zone& zone = zones[i];
+            if (zone.start < from || zone.start >= to) continue;
+            separator() << "{\"ph\":\"X\",\"name\":\"" << zone.name << "\",\"pid\":1,\"tid\":" << it->id
+                        << ",\"ts\":" << microseconds(zone.start) << ",\"dur\":" << (zone.end - zone.start) / rate << "}";
+        }
+    }
+
+    // The frame boundaries, as instant events across every thread
+    uint64_t count = frameCount.load(memory_order_acquire);
+    for (uint64_t i = count - min(count, FRAME_RING_SIZE); i < count; i++) {
+        uint64_t start = frameStarts[i % FRAME_RING_SIZE];
+        if (start < from || start >= to) continue;
+        separator() << "{\"ph\":\"i\",\"s\":\"g\",\"name\":\"Frame " << i << "\",\"pid\":1,\"tid\":0,\"ts\":"
+                    << microseconds(start) << "}";
+    }
+
+    out << "]}" << endl;
+    return (bool) out;
+}
+
+bool writeFrameTrace(const string& path, int frames) {
+    uint64_t count = frameCount.load(memory_order_acquire);
+    uint64_t n = min((uint64_t) max(frames, 1), min(count, FRAME_RING_SIZE));
+    uint64_t from = (n > 0) ? frameStarts[(count - n) % FRAME_RING_SIZE] : 0;
+    return writeTrace(path, from, UINT64_MAX);
+}
+
+bool writeStartupTrace(const string& path) {
+    uint64_t to = (frameCount.load(memory_order_acquire) > 0) ? firstFrame : UINT64_MAX;
+    return writeTrace(path, 0, to);
+}
@@ -0,0 +1,87 @@
+#ifndef OPENGL_PROFILER_H
+#define OPENGL_PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Scoped CPU zones, exported as Chrome trace events (open the file in chrome://tracing or ui.perfetto.dev).
+// Each thread records its zones in a ring buffer of its own, so recording is two reads of the CPU's tick counter &
+// a store with no locking, & the last few frames' worth are always there to export. The ticks are converted to
+// time when exporting, by comparing them with the steady clock (which costs several times as much to read).
+// Zones nest: a zone inside another (on the same thread) shows up under it.
+// The tick reads are most of a zone's cost: in virtual machines that emulate the counter, that's ~25ns each, so a
+// zone costs ~50ns there & is over the 50ns budget about half the time (tools/profilebench measures it)
+// Build with -DPROFILER=0 to compile the zones out entirely
+
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+// The profiler's clock: the time stamp counter on x86, the virtual counter on ARM (both run at a constant rate),
+// & the steady clock's nanoseconds elsewhere
+inline uint64_t profileTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Records a finished zone on the calling thread (in ticks). The name has to outlive the profiler (ie a literal)
+void recordZone(const char* name, uint64_t start, uint64_t end);
+
+// A named track for zones that aren't a thread's (ie the GPU's, see GpuProfiler.h), recorded by one thread at a time
+struct ProfileTrack;
+ProfileTrack* profileTrack(const char* name);
+void recordZone(ProfileTrack*, const char* name, uint64_t start, uint64_t end);
+
+// A copy of the name that lives as long as the profiler, for names that aren't literals (ie a model's path)
+const char* profileName(const std::string&);
+
+// Ticks per microsecond, measured over the run so far
+double profileTickRate();
+
+// Names the calling thread in the traces, & sets up its ring buffer (which allocates, so threads do it up front)
+void profileThread(const char* name);
+
+// Render thread: marks the start of a frame
+void profileFrame();
+
+// The zones of the last frames, or of everything before the first frame (as much of it as the rings still hold).
+// Both read the other threads' rings while they may be recording, so zones being overwritten are left out
+bool writeFrameTrace(const std::string& path, int frames);
+bool writeStartupTrace(const std::string& path);
+
+// Times the enclosing scope
+struct ProfileZone {
+    const char* name;
+    uint64_t start;
+
+    explicit ProfileZone(const char* n) : name(n), start(profileTicks()) {};
+    ~ProfileZone() { recordZone(name, start, profileTicks()); };
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if PROFILER
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) profileThread(name)
+#define PROFILE_FRAME() profileFrame()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_FRAME()
+#endif
+
+#endif //OPENGL_PROFILER_H
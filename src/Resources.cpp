@@ -0,0 +1,155 @@
+#include "Resources.h"
+#include "Objects/Object.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+// Handles pack the slot index (+1, so that 0 stays invalid) in the low 24 bits & the slot's generation in the high 8
+static const uint32_t SLOT_BITS = 24;
+static const uint32_t SLOT_MASK = (1u << SLOT_BITS) - 1;
+
+static ResourceHandle makeHandle(uint32_t slot, uint8_t generation) {
+    return ((uint32_t) generation << SLOT_BITS) | (slot + 1);
+}
+
+ResourceManager::ResourceManager() : _budget(DEFAULT_BUDGET), _used(0), _clock(0) {}
+
+ResourceManager& ResourceManager::get() {
+    static ResourceManager instance;
+    return instance;
+}
+
+std::string ResourceManager::textureKey(const std::string& path, const SamplerState& s) {
+    return path + "|" + std::to_string(s.wrap) + "|" + std::to_string(s.minFilter) + "|" + std::to_string(s.magFilter);
+}
+
+ResourceManager::Resource* ResourceManager::lookup(ResourceHandle h) {
+    uint32_t slot = (h & SLOT_MASK);
+    if (slot == 0 || slot > _resources.size()) return nullptr;
+    Resource* r = &_resources[slot - 1];
+    if (!r->alive || r->generation != (h >> SLOT_BITS)) return nullptr;
+    return r;
+}
+
+ResourceHandle ResourceManager::adopt(ResourceKind kind, GLuint id, size_t bytes, const std::string& key) {
+    uint32_t slot;
+    if (!_freeSlots.empty()) {
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+    } else {
+        slot = _resources.size();
+        _resources.push_back(Resource());
+        _resources.back().generation = 0;
+    }
+
+    Resource& r = _resources[slot];
+    r.kind = kind;
+    r.id = id;
+    r.key = key;
+    r.bytes = bytes;
+    r.refs = 1;
+    r.lastUse = ++_clock;
+    r.alive = true;
+
+    ResourceHandle h = makeHandle(slot, r.generation);
+    if (!key.empty()) _byKey[key] = h;
+    _used += bytes;
+
+    evict();
+    return h;
+}
+
+ResourceHandle ResourceManager::acquire(const std::string& key) {
+    auto it = _byKey.find(key);
+    if (it == _byKey.end()) return 0;
+    addRef(it->second);
+    return it->second;
+}
+
+void ResourceManager::addRef(ResourceHandle h) {
+    Resource* r = lookup(h);
+    if (!r) return;
+    r->refs++;
+    r->lastUse = ++_clock;
+}
+
+void ResourceManager::release(ResourceHandle h) {
+    Resource* r = lookup(h);
+    if (!r || r->refs == 0) return;
+    r->refs--;
+    r->lastUse = ++_clock;
+    if (r->refs > 0) return;
+
+    // Shared resources stay cached until they're evicted, anything else is deleted right away
+    if (r->key.empty()) destroy((h & SLOT_MASK) - 1);
+    else evict();
+}
+
+GLuint ResourceManager::id(ResourceHandle h) {
+    Resource* r = lookup(h);
+    return r ? r->id : 0;
+}
+
+size_t ResourceManager::bytes(ResourceHandle h) {
+    Resource* r = lookup(h);
+    return r ? r->bytes : 0;
+}
+
+void ResourceManager::setBudget(size_t bytes) {
+    _budget = bytes;
+    evict();
+}
+
+void ResourceManager::destroy(uint32_t slot) {
+    Resource& r = _resources[slot];
+    if (r.kind == RESOURCE_TEXTURE) glDeleteTextures(1, &r.id);
+    else                            glDeleteBuffers(1, &r.id);
+
+    if (!r.key.empty()) _byKey.erase(r.key);
+    _used -= r.bytes;
+
+    r.alive = false;
+    r.generation++;
+    r.key.clear();
+    _freeSlots.push_back(slot);
+}
+
+// Drop unreferenced resources, least recently used first, until we're back under budget
+void ResourceManager::evict() {
+    if (_used <= _budget) return;
+
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < _resources.size(); i++)
+        if (_resources[i].alive && _resources[i].refs == 0) candidates.push_back(i);
+    std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+        return _resources[a].lastUse < _resources[b].lastUse;
+    });
+
+    for (auto slot : candidates) {
+        if (_used <= _budget) break;
+        if (DEBUG) std::cout << "Evicting " << _resources[slot].key << std::endl;
+        destroy(slot);
+    }
+
+    if (_used > _budget)
+        std::cerr << "Warning: resources in use (" << _used / (1024 * 1024) << "MB) exceed the budget of "
+                  << _budget / (1024 * 1024) << "MB" << std::endl;
+}
+
+void ResourceManager::purge() {
+    for (uint32_t i = 0; i < _resources.size(); i++)
+        if (_resources[i].alive && _resources[i].refs == 0) destroy(i);
+}
+
+void ResourceManager::report() {
+    std::cout << "GPU resources (" << std::fixed << std::setprecision(2) << _used / (1024.0 * 1024.0) << "MB / "
+              << _budget / (1024.0 * 1024.0) << "MB):" << std::endl;
+    for (auto& r : _resources) {
+        if (!r.alive) continue;
+        std::cout << "  " << ((r.kind == RESOURCE_TEXTURE) ? "texture " : "buffer  ") << std::setw(4) << r.id
+                  << std::setw(10) << r.bytes / 1024.0 << "KB  refs=" << r.refs;
+        if (!r.key.empty()) std::cout << "  " << r.key.substr(0, r.key.find('|'));
+        std::cout << std::endl;
+    }
+}
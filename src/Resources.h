@@ -0,0 +1,88 @@
+#ifndef OPENGL_RESOURCES_H
+#define OPENGL_RESOURCES_H
+
+#include "Glad.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Opaque reference to a GL object owned by the ResourceManager (0 is never a valid handle)
+typedef uint32_t ResourceHandle;
+
+enum ResourceKind { RESOURCE_TEXTURE, RESOURCE_BUFFER };
+
+// Sampling parameters that are baked into a texture object, so they have to be part of its cache key
+struct SamplerState {
+    GLenum wrap;
+    GLenum minFilter;
+    GLenum magFilter;
+
+    SamplerState(GLenum w = GL_REPEAT, GLenum min = GL_LINEAR_MIPMAP_LINEAR, GLenum mag = GL_LINEAR) :
+            wrap(w), minFilter(min), magFilter(mag) {};
+};
+
+// Tracks every texture & buffer the scene creates: ownership is reference counted so that
+// cached resources can be shared between objects, and unreferenced resources stay cached
+// until the memory budget forces them out (least recently used first)
+class ResourceManager {
+    /********* Configurable settings *********/
+    const size_t DEFAULT_BUDGET = 512 * 1024 * 1024;   // bytes of GPU memory
+    /*****************************************/
+
+    struct Resource {
+        ResourceKind kind;
+        GLuint id;
+        std::string key;        // empty for resources that can't be shared
+        size_t bytes;
+        int refs;
+        uint64_t lastUse;
+        uint8_t generation;     // bumped each time the slot is reused so stale handles can be detected
+        bool alive;
+    };
+
+    std::vector<Resource> _resources;
+    std::vector<uint32_t> _freeSlots;
+    std::unordered_map<std::string, ResourceHandle> _byKey;
+
+    size_t _budget;
+    size_t _used;
+    uint64_t _clock;
+
+    ResourceManager();
+    Resource* lookup(ResourceHandle);
+    void destroy(uint32_t slot);
+    void evict();
+
+public:
+    static ResourceManager& get();
+
+    static std::string textureKey(const std::string& path, const SamplerState&);
+
+    // Registers a GL object that was just created - the caller holds the first reference
+    ResourceHandle adopt(ResourceKind, GLuint id, size_t bytes, const std::string& key = "");
+
+    // Returns a new reference to the resource cached under this key, or 0 if there isn't one
+    ResourceHandle acquire(const std::string& key);
+    bool contains(const std::string& key) { return _byKey.count(key) > 0; };
+
+    void addRef(ResourceHandle);
+    void release(ResourceHandle);
+
+    // Accessors
+    GLuint id(ResourceHandle);
+    size_t bytes(ResourceHandle);
+    size_t used() { return _used; };
+    size_t budget() { return _budget; };
+
+    void setBudget(size_t);
+
+    // Deletes every resource that is no longer referenced (must be called while the context is current)
+    void purge();
+
+    // Prints the per-resource memory accounting
+    void report();
+};
+
+#endif //OPENGL_RESOURCES_H
@@ -1,10 +1,52 @@
 #include "Scene.h"
 #include "Shaders.h"
+#include "Memory.h"
+#include "Assets.h"
+#include "Snapshot.h"
+#include "Allocations.h"
+#include "Latency.h"
+#include "Profiler.h"
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 
-Scene::Scene(double xpos, double ypos) : _isLit(true) {
+Scene::Scene(double xpos, double ypos) : _frame(&_loadFrame), _loadFrame(), _opaque(nullptr), _numOpaque(0),
+                                         _blended(nullptr), _numBlended(0), _prepared(1), _prepareTime(0), _isLit(true), _traceRequested(false), _objectsLit(true),
+                                         _settled(false), _steady(false), _allocations(0), _steadyAllocations(0), _time(0), _previousTime(0), _renderTime(0), _lodPolicy(LOD_SCREEN_SIZE),
+                                         _lodTriangles(), _depthPrepass(false), _cubes(nullptr) {
+    PROFILE_ZONE("Scene::Scene");
     auto timer = chrono::high_resolution_clock::now();
+    size_t residentBefore = residentMemory();
+    size_t faultsBefore = majorPageFaults();
+
+    // Read the assets out of the packed archive if it has been built (make archive), else the loose files
+    if (!mountArchive(ARCHIVE_PATH) && DEBUG) std::cout << "No asset archive at " << ARCHIVE_PATH << ", using loose files" << std::endl;
+
+    // Restore what the last run built while loading, if none of its sources have changed since
+    bool restored = openSnapshot(SNAPSHOT_PATH);
+
+    // Start compiling every program the scene can use (incl. the unlit variants for when the light is toggled)
+    compileShaders({
+            { "cubemap.vtx", "cubemap.frag", 0 },
+            { "shape.vtx",   "shape.frag",   SHADER_VERTEX_COLOR },
+            { "terrain.vtx", "terrain.frag", SHADER_LIT | SHADER_TEXTURED },
+            { "terrain.vtx", "terrain.frag", SHADER_TEXTURED },
+            { "cubes.vtx",   "cubes.frag",   SHADER_LIT | SHADER_TEXTURED },
+            { "cubes.vtx",   "cubes.frag",   SHADER_TEXTURED },
+            { "model.vtx",   "model.frag",   SHADER_LIT | SHADER_TEXTURED },
+            { "model.vtx",   "model.frag",   SHADER_LIT | SHADER_TEXTURED | SHADER_SPECULAR_MAP },
+            { "model.vtx",   "model.frag",   SHADER_TEXTURED },
+            { "model.vtx",   "model.frag",   SHADER_TEXTURED | SHADER_SPECULAR_MAP },
+            { "model.vtx",   "model.frag",   SHADER_LIT | SHADER_TEXTURED | SHADER_ALPHA_TEST },
+            { "model.vtx",   "model.frag",   SHADER_LIT | SHADER_TEXTURED | SHADER_SPECULAR_MAP | SHADER_ALPHA_TEST },
+            { "model.vtx",   "model.frag",   SHADER_TEXTURED | SHADER_ALPHA_TEST },
+            { "model.vtx",   "model.frag",   SHADER_TEXTURED | SHADER_SPECULAR_MAP | SHADER_ALPHA_TEST },
+            { "depth.vtx",   "depth.frag",   0 },
+    });
+    glGenQueries(NUM_PASS_QUERIES, _passQueries);
 
     // Create the skybox
     _skybox = new SkyBox(fetchShader("cubemap.vtx", "cubemap.frag"), this);
@@ -12,11 +54,12 @@ Scene::Scene(double xpos, double ypos) : _isLit(true) {
     // Create the light source
     glm::vec3 lightPos(0.0f, 10.0f, 0.0f);  // Note that light position is absolute (not relative to terrain)
     glm::vec3 lightCol(1.0f, 1.0f, 1.0f);
-    _lightSrc = new LightSource(fetchShader("shape.vtx", "shape.frag"), this, lightPos, lightCol);
+    _lightSrc = new LightSource(fetchShader("shape.vtx", "shape.frag", SHADER_VERTEX_COLOR), this, lightPos, lightCol);
     _lightSrc->setSize(0.5f);
 
     // Load the 1st terrain
-    Terrain* terrain = new Terrain(fetchShader("terrain.vtx", "terrain.frag"), this, "assets/heightmap.png");
+    GLuint terrainShader = fetchShader("terrain.vtx", "terrain.frag", SHADER_LIT | SHADER_TEXTURED);
+    Terrain* terrain = new Terrain(terrainShader, this, "assets/heightmap.png");
     terrain->setPosition(glm::vec3(-1 * terrain->getSize() / 2.0f, 0.0, -1 * terrain->getSize() / 2.0f));
     terrain->set2DTexture("assets/grass2.png");
     _objects.push_back(terrain);
@@ -25,50 +68,192 @@ Scene::Scene(double xpos, double ypos) : _isLit(true) {
 
     // Initialize the camera with the initial cursor position
     _c = new Camera(xpos, ypos, this);
+    buildFrame(_loadFrame);
 
-    loadShapes();
-    loadModels();
+    loadEntities();
     loadTerrains();
 
+    // Otherwise bake it for the next run (entities streamed in later aren't included)
+    if (snapshotRecording()) {
+        finishShaders();
+        saveSnapshot();
+    }
+
     if (DEBUG) {
         std::chrono::duration<double> loadingTime = chrono::high_resolution_clock::now() - timer;
-        std::cout << "Loaded scene data in " << loadingTime.count() << "s" << std::endl;
+        std::cout << "Loaded scene data in " << loadingTime.count() << "s "
+                  << (restored ? "(restored from " : "(baked into ") << SNAPSHOT_PATH << ")" << std::endl;
+        std::cout << "Resident memory: " << residentBefore / (1024 * 1024) << "MB before loading, "
+                  << residentMemory() / (1024 * 1024) << "MB after" << std::endl;
+        std::cout << "Major page faults while loading: " << majorPageFaults() - faultsBefore << std::endl;
+        reportAssetIO();
+        ResourceManager::get().report();
+        reportShaderSetup();
     }
 }
 
 Scene::~Scene() {
+    // The last frame's jobs are still running if drawing it threw
+    try {
+        JobSystem::get().wait(_sorted);
+    } catch (std::exception&) {}
+
     if (_skybox != nullptr) delete _skybox;
     if (_lightSrc != nullptr) delete _lightSrc;
     for (auto it : _objects)
         delete it;
+    glDeleteQueries(NUM_PASS_QUERIES, _passQueries);
+    deleteGpuQueries();
+
+    // Delete the cached resources that no object references anymore
+    ResourceManager::get().purge();
+    deleteShaders();
+    closeSnapshot();
+    unmountArchive();
 }
 
 int ticker = 0;
-void Scene::draw() {
+void Scene::buildFrame(FramePacket& frame) {
+    frame.view = _c->ViewMatrix();
+    frame.projection = _c->ProjMatrix();
+    frame.cameraPosition = _c->Position();
+    frame.fieldOfView = _c->FieldOfView();
+    frame.screenHeight = _c->ScreenHeight();
+    frame.time = _renderTime;
+
+    frame.lit = _isLit;
+    frame.depthPrepass = _depthPrepass;
+    frame.lodPolicy = _lodPolicy;
+    frame.writeTrace = _traceRequested;
+    _traceRequested = false;
+}
+
+void Scene::draw(const FramePacket& frame) {
     auto timer = chrono::high_resolution_clock::now();
+    checkAllocations();
+    _frame = &frame;
+
+    // The frames before this one
+    if (frame.writeTrace) {
+        if (writeFrameTrace(TRACE_PATH, TRACE_FRAMES)) std::cout << "Wrote a trace of the last " << TRACE_FRAMES
+                                                                 << " frames to " << TRACE_PATH << std::endl;
+        else std::cerr << "Error: couldn't write the trace to " << TRACE_PATH << std::endl;
+    }
+    PROFILE_ZONE("Scene::draw");
+    beginGpuFrame();
+
+    // Last frame's jobs & draws are done with its memory
+    _arena.reset();
+
+    bool changed = (frame.lit != _objectsLit) || frame.writeTrace;
+    if (changed) lightObjects(frame.lit);
 
-    // Enable blending to create transparency effect if a < 1
-    glEnable(GL_BLEND);
+    // Blending is only turned on for the blended pass
+    glDisable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // Enable depth test
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);       // accept fragment if closer to camera
 
+    for (auto& it : _lodTriangles) it = 0;
+
+    // Create the objects the camera has come close to & drop the ones it's left behind
+    {
+        PROFILE_ZONE("Stream entities");
+        changed |= streamEntities(false);
+    }
+
+    // Pick up the variants that weren't needed while loading, as the driver finishes them
+    {
+        PROFILE_ZONE("Poll shaders");
+        changed |= !pollShaders();
+    }
+
+    // Update the transforms (animation & culling) & prepare the objects (levels of detail & matrices) on the job
+    // system's threads, & then sort them into passes. Only the GL calls are made on this thread, which helps with
+    // the jobs while it waits for them
+    JobSystem& jobs = JobSystem::get();
+    auto prepareStart = chrono::high_resolution_clock::now();
+    updateFrustum();
+    jobs.parallelFor((_transforms.size() + 3) / 4, TRANSFORM_CHUNK / 4, [this](size_t begin, size_t end) {
+        PROFILE_ZONE("Update transforms");
+        _transforms.update(begin * 4, min(end * 4, _transforms.size()), _frame->time, _frustum);
+    });
+    jobs.parallelFor(_objects.size(), 0, [this](size_t begin, size_t end) {
+        PROFILE_ZONE("Prepare objects");
+        for (size_t i = begin; i < end; i++) _objects[i]->prepare();
+    }, _prepared);
+    jobs.runAfter(_prepared, [this] { sortObjects(); }, &_sorted);
+
+    // Periodically measure what each shader variant costs (reported with the drawing time below)
+    setShaderProfiling(DEBUG && ticker == 199);
+
     // Clear the screen
     glClearColor(0.0, 0.0, 0.0, 1.0);   // black
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // Measure the passes on a frame of their own (the shader profiling's timer queries can't be nested in them)
+    bool measurePasses = DEBUG && ticker == 198;
+    GLenum fragmentQuery = GLAD_GL_ARB_pipeline_statistics_query ? GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED;
+
     // Render our objects
     try {
-        if (_skybox != nullptr) _skybox->render();      // must always be 1st
+        {
+            PROFILE_ZONE("Wait for prepare");
+            jobs.wait(_prepared);
+        }
+        _prepareTime = chrono::duration<double>(chrono::high_resolution_clock::now() - prepareStart).count();
+
+        // Lay down the depth of the opaque objects first, so that they only shade their visible fragments
+        if (measurePasses) glBeginQuery(GL_TIME_ELAPSED, _passQueries[QUERY_DEPTH_TIME]);
+        if (frame.depthPrepass) {
+            PROFILE_ZONE("Depth pre-pass");
+            PROFILE_GPU_ZONE("Depth pre-pass");
+            GLuint depthShader = fetchShader("depth.vtx", "depth.frag");
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            for (auto it : _objects)
+                it->renderDepth(depthShader);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        }
+        if (measurePasses) {
+            glEndQuery(GL_TIME_ELAPSED);
+            glBeginQuery(GL_TIME_ELAPSED, _passQueries[QUERY_SHADING_TIME]);
+            glBeginQuery(fragmentQuery, _passQueries[QUERY_SHADED_FRAGMENTS]);
+        }
+
+        // Opaque & alpha-tested objects, without blending
+        {
+            PROFILE_ZONE("Opaque pass");
+            PROFILE_GPU_ZONE("Opaque pass");
+            if (_lightSrc != nullptr) _lightSrc->render();
+            else if (DEBUG && ticker == 200) std::cout << "Warning: light box is null" << std::endl;
+
+            jobs.wait(_sorted);
+            for (size_t i = 0; i < _numOpaque; i++)
+                _opaque[i]->render();
+        }
+
+        if (measurePasses) {
+            glEndQuery(GL_TIME_ELAPSED);
+            glEndQuery(fragmentQuery);
+        }
+
+        // After the opaque geometry, so that early-Z skips every pixel the scene already covers
+        if (_skybox != nullptr) _skybox->render();
         else if (DEBUG && ticker == 200) std::cout << "Warning: skybox is null" << std::endl;
 
-        if (_lightSrc != nullptr) _lightSrc->render();
-        else if (DEBUG && ticker == 200) std::cout << "Warning: light box is null" << std::endl;
-
-        for (auto it : _objects)
-            it->render();
+        // Blended objects last, back to front. They test against the depth but don't write it, so they don't hide each other
+        glEnable(GL_BLEND);
+        glDepthMask(GL_FALSE);
+        {
+            PROFILE_ZONE("Blended pass");
+            PROFILE_GPU_ZONE("Blended pass");
+            for (size_t i = 0; i < _numBlended; i++)
+                _blended[i].second->render();
+        }
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
     } catch (std::runtime_error& e) {
         std::string msg = "Exception thrown while attempting to render scene: ";
         throw EndProgramException(msg + e.what());
@@ -81,73 +266,255 @@ void Scene::draw() {
     // Flush the buffers
     glFlush();
 
+    // The debug reports & the shader profiling (the two frames before them) allocate, as does latency tracking
+    bool settled = !changed && !latencyTracking() && !(DEBUG && ticker >= 198);
+    _steady = settled && _settled;
+    _settled = settled;
+
     ticker++;
     if (DEBUG && ticker == 200) {   // periodically check how long the scene takes to draw
         ticker = 0;
         std::chrono::duration<double> drawingTime = chrono::high_resolution_clock::now() - timer;
-        std::cout << "Time to draw scene: " << drawingTime.count() << "s" << std::endl;
+        std::cout << "Time to draw scene: " << drawingTime.count() << "s (preparing " << _objects.size() << " objects on "
+                  << jobs.threads() << " threads: " << _prepareTime * 1000 << "ms)" << std::endl;
+        std::cout << "Model triangles per frame: " << _lodTriangles[LOD_FULL_DETAIL] << " at full detail, "
+                  << _lodTriangles[LOD_SCREEN_SIZE] << " with screen size LODs" << std::endl;
+        std::cout << "Frame arena: " << _arena.used() / 1024 << "KB used of " << _arena.capacity() / 1024 << "KB (peak "
+                  << _arena.peak() / 1024 << "KB), " << _steadyAllocations << " allocations in steady frames" << std::endl;
+        _steadyAllocations = 0;
+        reportShaderCosts();
+
+        GLuint64 depthTime, shadingTime, fragments;
+        glGetQueryObjectui64v(_passQueries[QUERY_DEPTH_TIME], GL_QUERY_RESULT, &depthTime);
+        glGetQueryObjectui64v(_passQueries[QUERY_SHADING_TIME], GL_QUERY_RESULT, &shadingTime);
+        glGetQueryObjectui64v(_passQueries[QUERY_SHADED_FRAGMENTS], GL_QUERY_RESULT, &fragments);
+        std::cout << "Depth pre-pass " << (frame.depthPrepass ? "on: " : "off: ") << depthTime / 1000 << "us depth + "
+                  << shadingTime / 1000 << "us shading, " << fragments << " fragments shaded ("
+                  << (GLAD_GL_ARB_pipeline_statistics_query ? "fragment shader invocations" : "samples passed") << ")" << std::endl;
+        reportGpuZones();
+
+        if (_skybox != nullptr) {
+            // Drawn first, the skybox would shade every pixel (the query counts samples)
+            GLint viewport[4], samples;
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glGetIntegerv(GL_SAMPLES, &samples);
+            GLuint64 pixels = (GLuint64) viewport[2] * viewport[3] * std::max(samples, 1);
+            GLuint64 shaded = _skybox->samplesPassed();
+            std::cout << "Skybox: " << shaded << " of " << pixels << " samples passed ("
+                      << (pixels ? 100 - 100 * shaded / pixels : 0) << "% rejected by the depth test)" << std::endl;
+        }
+    }
+}
+
+// Runs as a job once the objects are prepared. The lists are in the frame arena, sized for every object
+void Scene::sortObjects() {
+    PROFILE_ZONE("Sort objects");
+    _opaque = _arena.allocate<Object*>(_objects.size());
+    _blended = _arena.allocate<pair<float, Object*>>(_objects.size());
+    _numOpaque = _numBlended = 0;
+    glm::mat4 view = _frame->view;
+    for (auto it : _objects) {
+        if (it->blendMode() != BLEND_BLENDED) _opaque[_numOpaque++] = it;
+        else _blended[_numBlended++] = std::make_pair((view * glm::vec4(it->position(), 1.0f)).z, it);
+    }
+
+    // Back to front: view space z is negative in front of the camera, so farthest first is the smallest z
+    std::sort(_blended, _blended + _numBlended,
+              [](const pair<float, Object*>& a, const pair<float, Object*>& b) { return a.first < b.first; });
+}
+
+// Counts what the last frame allocated, on any thread, from its start to this one's
+void Scene::checkAllocations() {
+    uint64_t count = allocationCount();
+    uint64_t allocations = count - _allocations;
+    _allocations = count;
+    if (!_steady || allocations == 0) return;
+
+    _steadyAllocations += allocations;
+    if (ASSERT_NO_ALLOCATIONS)
+        throw EndProgramException("A steady frame made " + std::to_string(allocations) + " allocation(s)");
+}
+
+// The planes are the sums & differences of the view-projection matrix's last row & the others
+void Scene::updateFrustum() {
+    _viewProj = _frame->projection * _frame->view;
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(_viewProj[0][i], _viewProj[1][i], _viewProj[2][i], _viewProj[3][i]);
+
+    for (int i = 0; i < 3; i++) {
+        _frustum[2 * i] = rows[3] + rows[i];
+        _frustum[2 * i + 1] = rows[3] - rows[i];
     }
+    for (auto& it : _frustum)
+        it /= glm::length(glm::vec3(it));
 }
 
+
 void Scene::toggleLight() {
     _isLit = !_isLit;
     auto state = (_isLit) ? "on" : "off";
     if (DEBUG) std::cout << "Lighting turned " << state << std::endl;
+}
 
-    if (_lightSrc != nullptr) _lightSrc->isLit(_isLit);
+// Switching the programs is up to the render thread, once a packet has the new setting
+void Scene::lightObjects(bool lit) {
+    _objectsLit = lit;
+    if (_lightSrc != nullptr) _lightSrc->isLit(lit);
     for (auto it : _objects)
-        it->isLit(_isLit);
+        it->isLit(lit);
+}
+
+void Scene::requestTrace() {
+    _traceRequested = true;
+}
+
+void Scene::toggleDepthPrepass() {
+    _depthPrepass = !_depthPrepass;
+    if (DEBUG) std::cout << "Depth pre-pass " << (_depthPrepass ? "on" : "off") << std::endl;
+}
+
+void Scene::toggleLodPolicy() {
+    _lodPolicy = (_lodPolicy == LOD_FULL_DETAIL) ? LOD_SCREEN_SIZE : LOD_FULL_DETAIL;
+    if (DEBUG) std::cout << "Level of detail: " << ((_lodPolicy == LOD_FULL_DETAIL) ? "full" : "screen size") << std::endl;
+}
+
+static uint64_t cellKey(int x, int z) {
+    return ((uint64_t) (uint32_t) x << 32) | (uint32_t) z;
 }
 
-void Scene::loadShapes() {
-    Cube* cube1 = new Cube(fetchShader("shape.vtx", "shape.frag"), this);
-    cube1->set2DTexture("assets/crate.jpeg");
-    cube1->setPosition(glm::vec3(0.7, 0.7, 2.0));
-    cube1->setRotation(glm::vec3(0.0, -1.0, 0.0), 0.05);
-    cube1->setSize(0.1);
-    _objects.push_back(cube1);
+static float horizontalDistance(const SceneEntity& entity, glm::vec3 p) {
+    return glm::length(glm::vec2(entity.position[0] - p.x, entity.position[2] - p.z));
+}
 
-    Cube* cube2 = new Cube(fetchShader("shape.vtx", "shape.frag"), this);
-    cube2->set2DTexture("assets/stones.jpg");
-    cube2->setPosition(glm::vec3(-0.2, 0.65, 0.5));
-    cube2->setSize(0.15);
-    cube2->setRotation(glm::vec3(0.5, 1.0, 1.0));
-    _objects.push_back(cube2);
+void Scene::loadEntities() {
+    PROFILE_ZONE("Scene::loadEntities");
+    if (!loadSceneFile(SCENE_PATH, _description)) return;
+
+    // Bucket the entities so that only the cells around the camera need checking
+    _instances.assign(_description.entities.size(), nullptr);
+    _loaded.assign(_description.entities.size(), false);
+    for (uint32_t i = 0; i < _description.entities.size(); i++) {
+        const SceneEntity& entity = _description.entities[i];
+        int x = (int) floor(entity.position[0] / STREAM_RADIUS);
+        int z = (int) floor(entity.position[2] / STREAM_RADIUS);
+        _grid[cellKey(x, z)].push_back(i);
+    }
 
-    Cube* cube3 = new Cube(fetchShader("shape.vtx", "shape.frag"), this);
-    cube3->set2DTexture("assets/metal.jpg");
-    cube3->setPosition(glm::vec3(0.8, 0.9, -0.3));
-    cube3->setSize(0.3);
-    cube3->setRotation(glm::vec3(1.0, 0.0, 0.0), 0.03);
-    _objects.push_back(cube3);
+    streamEntities(true);
+    if (DEBUG) std::cout << "Scene " << SCENE_PATH << ": " << _description.entities.size() << " entities using "
+                         << _description.resources.size() << " resources, " << _liveEntities.size()
+                         << " instantiated within " << STREAM_RADIUS << " of the camera" << std::endl;
 }
 
-void Scene::loadModels() {
-    Model* nanosuit = new Model("assets/nanosuit/nanosuit.obj", fetchShader("model.vtx", "model.frag"), this);
-    nanosuit->setPosition(glm::vec3(3.0, 0.0, 2.0));
-    nanosuit->setRotation(glm::vec3(0.0, -1.0, 0.0));
-    nanosuit->setSize(0.06f);
-    nanosuit->setBlend(false);
-    _objects.push_back(nanosuit);
+bool Scene::streamEntities(bool initial) {
+    if (_description.entities.empty()) return false;
+
+    glm::vec3 camera = _frame->cameraPosition;
+    int created = 0, released = 0;
+    bool cubesChanged = false;
+
+    // Release what's out of range
+    for (size_t k = 0; k < _liveEntities.size(); ) {
+        uint32_t i = _liveEntities[k];
+        if (horizontalDistance(_description.entities[i], camera) <= STREAM_RADIUS * STREAM_HYSTERESIS) {
+            k++;
+            continue;
+        }
+        cubesChanged |= (_description.entities[i].kind == ENTITY_CUBE);
+        release(i);
+        _liveEntities[k] = _liveEntities.back();
+        _liveEntities.pop_back();
+        released++;
+    }
 
-    Model* tree = new Model("assets/Tree/Tree.obj", fetchShader("model.vtx", "model.frag"), this);
-    tree->setPosition(glm::vec3(5.0, 0.0, -0.5));
-    _objects.push_back(tree);
+    // Instantiate what's come into range (a radius wide cell means the 3x3 cells around the camera cover it)
+    int models = 0;
+    int cx = (int) floor(camera.x / STREAM_RADIUS);
+    int cz = (int) floor(camera.z / STREAM_RADIUS);
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            auto cell = _grid.find(cellKey(cx + dx, cz + dz));
+            if (cell == _grid.end()) continue;
+
+            for (uint32_t i : cell->second) {
+                const SceneEntity& entity = _description.entities[i];
+                if (_loaded[i] || horizontalDistance(entity, camera) > STREAM_RADIUS) continue;
+                if (entity.kind == ENTITY_MODEL && !initial && models >= MAX_INSTANTIATIONS) continue;
+
+                models += (entity.kind == ENTITY_MODEL);
+                cubesChanged |= (entity.kind == ENTITY_CUBE);
+                instantiate(i);
+                _liveEntities.push_back(i);
+                created++;
+            }
+        }
+    }
 
-    Model* patchOfGrass = new Model("assets/grasses/Grass_02.obj", fetchShader("model.vtx", "model.frag"), this);
-    patchOfGrass->setPosition(glm::vec3(3.3f, 0.0, -3.0));
-    patchOfGrass->setSize(0.60f);
-    patchOfGrass->setBlend(false);
-    _objects.push_back(patchOfGrass);
+    if (cubesChanged) rebuildCubes();
+    if (DEBUG && !initial && (created || released))
+        std::cout << "Streamed in " << created << " & out " << released << " entities (" << _liveEntities.size()
+                  << " live)" << std::endl;
+    return created || released;
+}
 
-    Model* fern = new Model("assets/grasses/Grass_01.obj", fetchShader("model.vtx", "model.frag"), this);
-    fern->setPosition(glm::vec3(-2.0, 0.0, 1.0));
-    fern->setBlend(false);
-    _objects.push_back(fern);
+void Scene::instantiate(uint32_t i) {
+    const SceneEntity& entity = _description.entities[i];
+    _loaded[i] = true;
+    if (entity.kind != ENTITY_MODEL) return;    // cubes are added to the batch by rebuildCubes
+
+    Model* model = new Model(_description.resources[entity.resource],
+                             fetchShader("model.vtx", "model.frag", SHADER_LIT | SHADER_TEXTURED), this);
+    model->setPosition(glm::vec3(entity.position[0], entity.position[1], entity.position[2]));
+    model->setRotation(glm::vec3(entity.rotation[0], entity.rotation[1], entity.rotation[2]));
+    model->setSize(entity.size);
+    if (entity.flags & ENTITY_OPAQUE) model->setBlendMode(BLEND_OPAQUE);
+    else if (entity.flags & ENTITY_ALPHA_TESTED) model->setBlendMode(BLEND_ALPHA_TESTED);
+    else model->setBlendMode(BLEND_BLENDED);
+    if (!_objectsLit) model->isLit(false);
+
+    _instances[i] = model;
+    _objects.push_back(model);
 }
 
+void Scene::release(uint32_t i) {
+    _loaded[i] = false;
+    if (_instances[i] == nullptr) return;
+
+    _objects.erase(std::find(_objects.begin(), _objects.end(), _instances[i]));
+    delete _instances[i];
+    _instances[i] = nullptr;
+}
+
+// The cubes in range share one batch, so it's rebuilt whenever they change
+// (the texture arrays are cached, so it's only the instance data that is redone)
+void Scene::rebuildCubes() {
+    PROFILE_ZONE("Scene::rebuildCubes");
+    if (_cubes != nullptr) {
+        _objects.erase(std::find(_objects.begin(), _objects.end(), _cubes));
+        delete _cubes;
+        _cubes = nullptr;
+    }
+
+    std::vector<uint32_t> cubes;
+    for (uint32_t i : _liveEntities)
+        if (_description.entities[i].kind == ENTITY_CUBE) cubes.push_back(i);
+    if (cubes.empty()) return;
+
+    _cubes = new CubeBatch(fetchShader("cubes.vtx", "cubes.frag", SHADER_LIT | SHADER_TEXTURED), this);
+    for (uint32_t i : cubes) {
+        const SceneEntity& entity = _description.entities[i];
+        _cubes->addCube(_description.resources[entity.resource],
+                        glm::vec3(entity.position[0], entity.position[1], entity.position[2]), entity.size,
+                        glm::vec3(entity.rotation[0], entity.rotation[1], entity.rotation[2]), entity.speed);
+    }
+    _cubes->build();
+    if (!_objectsLit) _cubes->isLit(false);
+    _objects.push_back(_cubes);
+}
 
 void Scene::loadTerrains() {
+    PROFILE_ZONE("Scene::loadTerrains");
     // TODO load other terrains
 }
 
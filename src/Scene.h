@@ -3,8 +3,13 @@
 
 #include "Objects/Object.h"
 #include "Camera.h"
+#include "SceneFile.h"
+#include "Jobs.h"
+#include "Frame.h"
+#include "Arena.h"
 
 #include <vector>
+#include <unordered_map>
 
 struct EndProgramException : public std::exception {
     std::string info;
@@ -13,27 +18,120 @@ struct EndProgramException : public std::exception {
 };
 
 class Scene {
+    /********* Configurable settings *********/
+    const std::string ARCHIVE_PATH = "assets.pack";     // built by `make archive`
+    const std::string SCENE_PATH = "assets/scenes/main.scene";
+    const std::string SNAPSHOT_PATH = "cache/scene.snapshot";   // everything built while loading (see Snapshot.h)
+    const float STREAM_RADIUS = 25.0f;      // entities closer than this to the camera (horizontally) are instantiated...
+    const float STREAM_HYSTERESIS = 1.25f;  // ...& released once they're this many radii away
+    const int MAX_INSTANTIATIONS = 2;       // models created per frame once the scene is running (importing is slow)
+    const size_t TRANSFORM_CHUNK = 4096;    // transforms updated per job
+    const bool ASSERT_NO_ALLOCATIONS = DEBUG;   // end the program when a steady frame allocates (see checkAllocations)
+    const std::string TRACE_PATH = "cache/frames.json";     // where requestTrace writes the profiler's zones...
+    const int TRACE_FRAMES = 10;                            // ...of this many frames
+    /*****************************************/
+
     Camera* _c;
     SkyBox* _skybox;
     LightSource* _lightSrc;
     Terrain* _currTerrain;
 
+    // The scene is simulated on the main thread & drawn on the render thread, which only reads the frame packet:
+    // the camera, clock & settings below are the simulation's, everything else (the objects) is the renderer's
+    const FramePacket* _frame;      // the packet being drawn
+    FramePacket _loadFrame;         // the one objects see while the scene is loading
+
     std::vector<Object*> _objects;
 
+    // Memory for this frame only, reset when the next one starts (see Arena.h)
+    FrameArena _arena;
+
+    // This frame's opaque & alpha-tested objects, & blended objects by view space depth (in the arena)
+    Object** _opaque;
+    size_t _numOpaque;
+    std::pair<float, Object*>* _blended;
+    size_t _numBlended;
+
+    // Every object's transform & bounds, updated together each frame
+    TransformStore _transforms;
+
+    // The camera as of this frame: its view-projection matrix & the planes of its frustum (pointing inwards)
+    glm::mat4 _viewProj;
+    glm::vec4 _frustum[6];
+    void updateFrustum();
+
+    // The CPU side of the frame (preparing the objects & sorting them into passes) runs on the job system
+    JobCounter _prepared;
+    JobCounter _sorted;
+    double _prepareTime;    // seconds from starting the preparation until it was done, as of the last frame
+    void sortObjects();
+
     bool _isLit;
+    bool _traceRequested;
+    bool _objectsLit;       // the lighting the objects have, which follows the packets' (render thread)
+
+    // A frame that doesn't change the scene (nothing streamed, compiled, toggled or reported) mustn't allocate once
+    // it's loaded: the global operator new calls (see Allocations.h) are counted from one frame's start to the next's.
+    // The first such frame after a change is a warm-up, which grows what the change left empty (ie the job queues)
+    bool _settled;                  // the last frame didn't change the scene...
+    bool _steady;                   // ...& nor did the one before it
+    uint64_t _allocations;          // the count when it started
+    uint64_t _steadyAllocations;    // made by steady frames, since the last report
+    void checkAllocations();
+
+    // Simulation time (seconds) as of the last step, the one before & the frame being drawn
+    double _time;
+    double _previousTime;
+    double _renderTime;
 
-    void loadShapes();
-    void loadModels();
+    // Level of detail selection & the triangles each policy would draw this frame
+    LodPolicy _lodPolicy;
+    size_t _lodTriangles[NUM_LOD_POLICIES];
+
+    // Depth-only pass over the opaque objects before they're shaded, & the queries that measure whether it pays off
+    // (GPU time of each pass & the fragments shaded, with pipeline statistics if available or else samples passed).
+    // They're kept apart from the GPU zones, which compile out with the profiler & average over frames of either kind
+    enum PassQuery { QUERY_DEPTH_TIME, QUERY_SHADING_TIME, QUERY_SHADED_FRAGMENTS, NUM_PASS_QUERIES };
+    bool _depthPrepass;
+    GLuint _passQueries[NUM_PASS_QUERIES];
+
+    // Entities from the scene file, which only have objects while the camera is near them
+    SceneDescription _description;
+    std::vector<Object*> _instances;        // for each entity (cubes share _cubes instead)
+    std::vector<bool> _loaded;
+    std::vector<uint32_t> _liveEntities;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> _grid;     // entities by STREAM_RADIUS sized cell
+    CubeBatch* _cubes;
+
+    void loadEntities();
+    bool streamEntities(bool initial);      // the initial load has no instantiation limit - true if anything changed
+    void instantiate(uint32_t entity);
+    void release(uint32_t entity);
+    void rebuildCubes();
     void loadTerrains();
 
+    void lightObjects(bool);
     void handleErr(GLenum); // Can throw a EndProgramException
 
 public:
     Scene(double, double);
     ~Scene();
 
-    void draw(); // Can throw a EndProgramException
+    // Simulation thread: fills in the packet for the frame at the current (interpolated) state
+    void buildFrame(FramePacket&);
+
+    // Render thread
+    void draw(const FramePacket&); // Can throw a EndProgramException
+    const FramePacket& frame() { return *_frame; };
+
+    // Settings (the renderer picks them up with the next packet)
     void toggleLight();
+    void toggleLodPolicy();
+    void toggleDepthPrepass();
+    void requestTrace();    // of the last frames, in the trace event format (see Profiler.h)
+
+    LodPolicy lodPolicy() { return _frame->lodPolicy; };
+    void countTriangles(LodPolicy p, size_t n) { _lodTriangles[p] += n; };
 
     // Accessors - can all throw std::runtime_error exception
     Camera* camera();
@@ -45,7 +143,17 @@ public:
     void Move(Direction d) { _c->Move(d); };
     void Zoom(float z) { _c->Zoom(z); };
     void Jump() { _c->Jump(); };
-    void Tick() { _c->Tick(); };
+
+    // Simulation clock: advanced in fixed steps, & interpolated between the last two for drawing
+    void Step(float dt) { _c->Step(dt); _previousTime = _time; _time += dt; };
+    void Interpolate(float alpha) { _c->Interpolate(alpha); _renderTime = _previousTime + (_time - _previousTime) * alpha; };
+    double time() { return _frame->time; };     // seconds, as of the frame being drawn
+
+    // Camera state for the frame being drawn (also safe to read from the jobs in Object::prepare)
+    const glm::mat4& viewProjection() { return _viewProj; };
+
+    TransformStore& transforms() { return _transforms; };
+    FrameArena& arena() { return _arena; };     // safe to allocate from in the jobs too
 };
 
 
@@ -0,0 +1,212 @@
+#include "SceneFile.h"
+#include "Assets.h"
+#include "Snapshot.h"
+
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char* CACHE_DIR = "cache/scenes";
+static const uint32_t COMPILED_MAGIC = 0x424e4353;     // "SCNB"
+static const uint32_t COMPILED_VERSION = 1;
+
+// Binary form: the header, each resource path (a 32 bit length & the characters) & then the entity records
+struct CompiledHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numResources;
+    uint32_t numEntities;
+    int64_t sourceSize;
+    int64_t sourceMTime;
+};
+
+static string cachePath(const string& path) {
+    stringstream name;
+    name << CACHE_DIR << "/" << hex << hash<string>()(path) << ".sceneb";
+    return name.str();
+}
+
+/*************************************************************
+                          Text form
+ *************************************************************/
+
+// Reads "count" floats following a keyword
+static bool readFloats(istringstream& words, float* out, int count) {
+    for (int i = 0; i < count; i++)
+        if (!(words >> out[i])) return false;
+    return true;
+}
+
+static bool parseLine(const string& line, SceneDescription& scene, unordered_map<string, uint32_t>& resourceIds,
+                      string& error) {
+    istringstream words(line);
+    string kind, resource;
+    if (!(words >> kind) || kind[0] == '#') return true;    // blank or comment
+
+    SceneEntity entity = { ENTITY_MODEL, 0, { 0, 0, 0 }, { 0, 0, 0 }, 1.0f, 0.0f, 0 };
+    if (kind == "model") entity.kind = ENTITY_MODEL;
+    else if (kind == "cube") entity.kind = ENTITY_CUBE;
+    else {
+        error = "unknown entity type " + kind;
+        return false;
+    }
+
+    if (!(words >> resource)) {
+        error = kind + " without a path";
+        return false;
+    }
+
+    string key;
+    while (words >> key) {
+        bool ok = true;
+        if (key[0] == '#') break;
+        else if (key == "position") ok = readFloats(words, entity.position, 3);
+        else if (key == "rotation") ok = readFloats(words, entity.rotation, 3);
+        else if (key == "size") ok = readFloats(words, &entity.size, 1);
+        else if (key == "speed") ok = readFloats(words, &entity.speed, 1);
+        else if (key == "opaque") entity.flags |= ENTITY_OPAQUE;
+        else if (key == "alphatest") entity.flags |= ENTITY_ALPHA_TESTED;
+        else {
+            error = "unknown property " + key;
+            return false;
+        }
+        if (!ok) {
+            error = "bad value for " + key;
+            return false;
+        }
+    }
+
+    auto id = resourceIds.find(resource);
+    if (id == resourceIds.end()) {
+        id = resourceIds.emplace(resource, scene.resources.size()).first;
+        scene.resources.push_back(resource);
+    }
+    entity.resource = id->second;
+    scene.entities.push_back(entity);
+    return true;
+}
+
+// A line at a time straight out of the file's bytes (malformed lines are reported & skipped)
+static bool parseText(const string& path, SceneDescription& scene) {
+    AssetData file = readAsset(path);
+    if (!file.valid()) return false;
+
+    unordered_map<string, uint32_t> resourceIds;
+    const char* text = (const char*) file.data();
+    const char* end = text + file.size();
+    int lineNumber = 0;
+    while (text < end) {
+        const char* eol = (const char*) memchr(text, '\n', end - text);
+        if (!eol) eol = end;
+        lineNumber++;
+
+        string error;
+        if (!parseLine(string(text, eol), scene, resourceIds, error))
+            cerr << path << ":" << lineNumber << ": " << error << " (line skipped)" << endl;
+        text = eol + 1;
+    }
+    return true;
+}
+
+/*************************************************************
+                         Binary form
+ *************************************************************/
+
+static bool readCompiled(const unsigned char* data, size_t size, int64_t sourceSize, int64_t sourceMTime,
+                         SceneDescription& scene) {
+    if (!data || size < sizeof(CompiledHeader)) return false;
+
+    CompiledHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != COMPILED_MAGIC || header.version != COMPILED_VERSION
+        || header.sourceSize != sourceSize || header.sourceMTime != sourceMTime)
+        return false;   // stale - the text has changed since it was compiled
+
+    const unsigned char* in = data + sizeof(header);
+    const unsigned char* end = data + size;
+    scene.resources.resize(header.numResources);
+    for (auto& resource : scene.resources) {
+        uint32_t length;
+        if (end - in < (ptrdiff_t) sizeof(length)) return false;
+        memcpy(&length, in, sizeof(length));
+        in += sizeof(length);
+        if (end - in < (ptrdiff_t) length) return false;
+        resource.assign((const char*) in, length);
+        in += length;
+    }
+
+    if ((size_t) (end - in) != header.numEntities * sizeof(SceneEntity)) return false;
+    scene.entities.resize(header.numEntities);
+    memcpy(scene.entities.data(), in, end - in);
+
+    for (auto& entity : scene.entities)
+        if (entity.resource >= scene.resources.size()) return false;
+    return true;
+}
+
+static SnapshotWriter compile(int64_t sourceSize, int64_t sourceMTime, const SceneDescription& scene) {
+    SnapshotWriter out;
+    CompiledHeader header = { COMPILED_MAGIC, COMPILED_VERSION, (uint32_t) scene.resources.size(),
+                              (uint32_t) scene.entities.size(), sourceSize, sourceMTime };
+    out.write(header);
+    for (auto& resource : scene.resources)
+        out.write(resource);
+    out.append(scene.entities.data(), scene.entities.size() * sizeof(SceneEntity));
+    return out;
+}
+
+static void writeCompiled(const string& path, SnapshotWriter& compiled) {
+    mkdir("cache", 0755);
+    mkdir(CACHE_DIR, 0755);
+
+    // Write to a temporary file first so a concurrent reader never sees a half-written scene
+    string target = cachePath(path);
+    string tmp = target + ".tmp";
+    ofstream file(tmp, ios::binary);
+    if (!file) return;
+    file.write((const char*) compiled.data().data(), compiled.data().size());
+    file.close();
+
+    if (file) rename(tmp.c_str(), target.c_str());
+    else remove(tmp.c_str());
+}
+
+bool loadSceneFile(const string& path, SceneDescription& scene) {
+    int64_t size, mtime;
+    if (!assetStamp(path, size, mtime)) {
+        cerr << "Error: can't find scene file " << path << endl;
+        return false;
+    }
+
+    snapshotDepends(path);
+
+    // The scene snapshot carries the compiled form too, so a restored scene doesn't open the cache file
+    SnapshotReader reader;
+    scene = SceneDescription();
+    if (findSnapshot("scene:" + path, reader)) {
+        size_t length = reader.remaining();
+        if (readCompiled(reader.view(length), length, size, mtime, scene)) return true;
+    }
+
+    scene = SceneDescription();
+    AssetData file = readAsset(cachePath(path));
+    bool compiled = file.valid() && readCompiled(file.data(), file.size(), size, mtime, scene);
+    if (!compiled) {
+        scene = SceneDescription();
+        if (!parseText(path, scene)) {
+            cerr << "Error: can't read scene file " << path << endl;
+            return false;
+        }
+    }
+
+    SnapshotWriter out = compile(size, mtime, scene);
+    if (!compiled) writeCompiled(path, out);
+    addSnapshot("scene:" + path, std::move(out));
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef OPENGL_SCENEFILE_H
+#define OPENGL_SCENEFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scene description files: a text form for authoring (assets/scenes/*.scene, one entity per line)
+//
+//   # comment
+//   model <path>     [position x y z] [rotation x y z] [size s] [opaque | alphatest]
+//   cube  <texture>  [position x y z] [rotation x y z] [size s] [speed s]
+//
+// which is compiled to a binary form in cache/scenes/ the first time it's loaded (& again whenever
+// the text changes). Positions are relative to the terrain, as with Object::setPosition.
+// Models without opaque or alphatest are alpha blended
+
+enum EntityKind : uint32_t {
+    ENTITY_MODEL,
+    ENTITY_CUBE,
+};
+
+enum EntityFlags : uint32_t {
+    ENTITY_OPAQUE = 1 << 0,         // drawn without blending
+    ENTITY_ALPHA_TESTED = 1 << 1,   // cut out where the textures are transparent (ie foliage), also without blending
+};
+
+// One entity (a fixed size record in the binary form)
+struct SceneEntity {
+    uint32_t kind;
+    uint32_t resource;      // index into SceneDescription::resources: the model's path or the cube's texture
+    float position[3];
+    float rotation[3];      // axis (all 0 for none)
+    float size;
+    float speed;            // cubes only: rotations per second (0 faces the rotation axis)
+    uint32_t flags;
+};
+
+struct SceneDescription {
+    std::vector<std::string> resources;     // each distinct path, once
+    std::vector<SceneEntity> entities;
+};
+
+// Reads the compiled form (compiling the text first if needed) - returns false if neither can be read
+bool loadSceneFile(const std::string& path, SceneDescription&);
+
+#endif //OPENGL_SCENEFILE_H
@@ -1,24 +1,104 @@
 #include <iostream>
 #include <fstream>
-#include <OpenGL/gl.h>
+#include <sstream>
+#include <map>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <chrono>
+#include "Glad.h"
 #include "Shaders.h"
+#include "Snapshot.h"
 
 using namespace std;
 
-static const GLchar* readShader( const char* filename ) {
-    ifstream file(filename, ios::binary|ios::ate);
+static const string SHADER_DIR = "src/shaders/";
+
+// Configurable settings
+static const bool PARALLEL_SHADER_COMPILE = true;  // use KHR/ARB_parallel_shader_compile when the driver has it
+
+// Names of the #defines for each ShaderFeature bit
+static const char* FEATURE_NAMES[] = { "LIT", "TEXTURED", "VERTEX_COLOR", "SPECULAR_MAP", "ALPHA_TEST" };
+static const int NUM_FEATURES = sizeof(FEATURE_NAMES) / sizeof(FEATURE_NAMES[0]);
+
+// Every variant binds its vertex attributes to the same locations, so that switching an object
+// to another variant doesn't invalidate its vertex array object
+static const pair<const char*, GLuint> ATTRIBUTE_LOCATIONS[] = {
+        { "vPosition", 0 }, { "vNormal", 1 }, { "vTexture", 2 }, { "vColor", 3 },
+        { "iModel", 4 },    // a mat4 takes 4 locations
+        { "iUvRect", 8 }, { "iLayer", 9 }
+};
+
+// Compiled programs, by shader files & features
+struct ShaderVariant {
+    string vtx;
+    string frag;
+    unsigned int features;
+};
+typedef tuple<string, string, unsigned int> ProgramKey;
+static map<ProgramKey, GLuint> programs;
+static unordered_map<GLuint, ShaderVariant> variants;
+
+static string featureString(unsigned int features) {
+    string result;
+    for (int i = 0; i < NUM_FEATURES; i++)
+        if (features & (1 << i)) result += (result.empty() ? "" : " ") + string(FEATURE_NAMES[i]);
+    return result.empty() ? "no features" : result;
+}
+
+static bool readShader( const string& filename, string& source ) {
+    ifstream file(filename, ios::binary);
     if ( !file ) {
         cerr << "Unable to open " << filename << std::endl;
-        return NULL;
+        return false;
     }
 
-    int length = file.tellg();
-    GLchar* data = new GLchar[length + 1];
-    file.seekg(0, ios::beg);
-    file.read(data, length);
-    data[length] = 0;
+    stringstream contents;
+    contents << file.rdbuf();
+    source = contents.str();
+    return true;
+}
+
+// Expands #include "file" lines (relative to the shader directory, each file at most once)
+static bool expandIncludes( const string& filename, string& out, set<string>& included ) {
+    string source;
+    if (!readShader(filename, source)) return false;
+    snapshotDepends(filename);
 
-    return data;
+    istringstream lines(source);
+    string line;
+    while (getline(lines, line)) {
+        size_t directive = line.find("#include");
+        if (directive != string::npos && line.find_first_not_of(" \t") == directive) {
+            size_t open = line.find('"', directive);
+            size_t close = line.find('"', open + 1);
+            if (open == string::npos || close == string::npos) {
+                cerr << "Malformed #include in " << filename << ": " << line << endl;
+                return false;
+            }
+            string path = SHADER_DIR + line.substr(open + 1, close - open - 1);
+            if (included.insert(path).second && !expandIncludes(path, out, included)) return false;
+            continue;
+        }
+        out += line + "\n";
+    }
+    return true;
+}
+
+// The source with its includes expanded & the features #defined (right after the #version line)
+static bool preprocess( const string& filename, unsigned int features, string& out ) {
+    string source;
+    set<string> included = { filename };
+    if (!expandIncludes(filename, source, included)) return false;
+
+    string defines;
+    for (int i = 0; i < NUM_FEATURES; i++)
+        if (features & (1 << i)) defines += "#define " + string(FEATURE_NAMES[i]) + "\n";
+
+    size_t version = source.find("#version");
+    size_t insertAt = (version == string::npos) ? 0 : source.find('\n', version) + 1;
+    out = source.substr(0, insertAt) + defines + source.substr(insertAt);
+    return true;
 }
 
 void cleanup(std::vector<ShaderInfo>& shaders) {
@@ -29,7 +109,9 @@ void cleanup(std::vector<ShaderInfo>& shaders) {
     }
 }
 
-GLuint loadShaders( std::vector<ShaderInfo>& shaders ) {
+// Hands the shaders & the link to the driver without asking for any status, so a driver that
+// compiles in the background (KHR_parallel_shader_compile) isn't forced to finish
+static GLuint submitProgram( std::vector<ShaderInfo>& shaders, unsigned int features ) {
     if ( shaders.empty() ) return 0;
 
     GLuint program = glCreateProgram();
@@ -39,40 +121,55 @@ GLuint loadShaders( std::vector<ShaderInfo>& shaders ) {
         entry.shader = shader;
 
         // Read the shader file
-        const GLchar* source = readShader(entry.filename);
-        if (!source) {
+        string source;
+        if (!preprocess(entry.filename, features, source)) {
             cerr << "Error reading " << entry.filename << endl;
             cleanup(shaders);
+            glDeleteProgram(program);
             return 0;
         }
 
-        // Compile the shader
-        glShaderSource(shader, 1, &source, NULL);
-        delete [] source;
+        // Compile the shader & add it to the program
+        const GLchar* src = source.c_str();
+        glShaderSource(shader, 1, &src, NULL);
         glCompileShader(shader);
+        glAttachShader( program, shader );
+    }
+
+    for (auto& it : ATTRIBUTE_LOCATIONS)
+        glBindAttribLocation(program, it.second, it.first);
 
-        // Check for compilation errors
+    // The linked binary goes into the scene snapshot
+    if (snapshotRecording()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glLinkProgram( program );
+    return program;
+}
+
+// Checks the results of submitProgram (blocking until the driver is done) & returns the program, or 0
+static GLuint finishProgram( GLuint program, std::vector<ShaderInfo>& shaders, unsigned int features ) {
+    if ( !program ) return 0;
+
+    // Check for compilation errors
+    for (ShaderInfo& entry : shaders) {
         GLint compiled;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        glGetShaderiv(entry.shader, GL_COMPILE_STATUS, &compiled);
         if (!compiled) {
             // Retrieve the compile log
             GLsizei length;
-            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            glGetShaderiv(entry.shader, GL_INFO_LOG_LENGTH, &length);
             GLchar* buffer = new GLchar[length+1];
-            glGetShaderInfoLog(shader, length, &length, buffer);
-            cerr << "Failed to compile " << entry.filename << ": " << buffer << endl;
+            glGetShaderInfoLog(entry.shader, length, &length, buffer);
+            cerr << "Failed to compile " << entry.filename << " (" << featureString(features) << "): " << buffer << endl;
 
             delete [] buffer;
             cleanup(shaders);
+            glDeleteProgram(program);
             return 0;
         }
-
-        // Add the shader to the program
-        glAttachShader( program, shader );
     }
 
-    // Link the program
-    glLinkProgram( program );
+    // Check the link
     GLint linked;
     glGetProgramiv(program, GL_LINK_STATUS, &linked);
     if (!linked) {
@@ -83,21 +180,285 @@ GLuint loadShaders( std::vector<ShaderInfo>& shaders ) {
         cerr << "Shader linking failed: " << buffer << endl;
 
         cleanup(shaders);
+        glDeleteProgram(program);
         delete [] buffer;
         return 0;
     }
 
+    // The program keeps the compiled code
+    cleanup(shaders);
+    return program;
+}
+
+GLuint loadShaders( std::vector<ShaderInfo>& shaders, unsigned int features ) {
+    return finishProgram(submitProgram(shaders, features), shaders, features);
+}
+
+/*************************************************************
+                        Program cache
+ *************************************************************/
+
+// A program that's been submitted but whose status hasn't been checked yet
+struct PendingProgram {
+    GLuint program;
+    string vtxPath;     // ShaderInfo only points at the file names
+    string fragPath;
+    vector<ShaderInfo> shaders;
+};
+static map<ProgramKey, PendingProgram> pending;
+
+// Timing of the last compileShaders batch
+static chrono::high_resolution_clock::time_point batchStart;
+static double submitSeconds = 0;
+static double readySeconds = 0;
+static int batchSize = 0;
+static int restoredPrograms = 0;
+
+static string snapshotKey(const ProgramKey& key) {
+    return "program:" + get<0>(key) + "|" + get<1>(key) + "|" + to_string(get<2>(key));
+}
+
+// Loads the program's binary from the scene snapshot - 0 if it isn't there, or if the driver
+// rejects it (ie it's been updated since), in which case the program is compiled from source
+static GLuint restoreProgram(const ProgramKey& key) {
+    SnapshotReader reader;
+    if (!findSnapshot(snapshotKey(key), reader)) return 0;
+
+    GLenum format = reader.read<uint32_t>();
+    uint32_t length = reader.read<uint32_t>();
+    const unsigned char* binary = reader.view(length);
+    if (!binary) return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, binary, length);
+    GLint linked;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    restoredPrograms++;
     return program;
 }
 
+// Caches a program (& records its binary while a snapshot is being made)
+static GLuint registerProgram(const ProgramKey& key, GLuint program) {
+    programs[key] = program;
+    if (!program) return 0;
+    variants[program] = { get<0>(key), get<1>(key), get<2>(key) };
+
+    if (snapshotRecording()) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        vector<unsigned char> binary(length);
+        GLenum format = 0;
+        if (length > 0) glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        if (length > 0) {
+            SnapshotWriter writer;
+            writer.write((uint32_t) format);
+            writer.write((uint32_t) length);
+            writer.append(binary.data(), length);
+            addSnapshot(snapshotKey(key), std::move(writer));
+        }
+    }
+    return program;
+}
+
+static bool parallelCompile() {
+    return PARALLEL_SHADER_COMPILE && (GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile);
+}
+
+// Checks a pending program & moves it into the cache
+static GLuint finishPending(map<ProgramKey, PendingProgram>::iterator it) {
+    auto& key = it->first;
+    PendingProgram& p = it->second;
+    GLuint program = registerProgram(key, finishProgram(p.program, p.shaders, get<2>(key)));
+    pending.erase(it);
+
+    if (pending.empty()) {
+        chrono::duration<double> ready = chrono::high_resolution_clock::now() - batchStart;
+        readySeconds = ready.count();
+    }
+    return program;
+}
+
+void compileShaders(const std::vector<ShaderRequest>& requests) {
+    batchStart = chrono::high_resolution_clock::now();
+    batchSize = 0;
+    restoredPrograms = 0;
+
+    // Without the extension every status query waits for the driver anyway, so compile one by one
+    if (!parallelCompile()) {
+        for (auto& request : requests) {
+            auto key = make_tuple(request.vtx, request.frag, request.features);
+            if (!programs.count(key)) batchSize++;
+            fetchShader(request.vtx, request.frag, request.features);
+        }
+        chrono::duration<double> total = chrono::high_resolution_clock::now() - batchStart;
+        submitSeconds = readySeconds = total.count();
+        return;
+    }
+
+    // Let the driver use as many compiler threads as it likes
+    if (GLAD_GL_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+    for (auto& request : requests) {
+        auto key = make_tuple(request.vtx, request.frag, request.features);
+        if (programs.count(key) || pending.count(key)) continue;
+        batchSize++;
+        if (GLuint program = restoreProgram(key)) {
+            registerProgram(key, program);
+            continue;
+        }
+
+        PendingProgram& p = pending[key];
+        p.vtxPath = SHADER_DIR + request.vtx;
+        p.fragPath = SHADER_DIR + request.frag;
+        p.shaders = {
+                { GL_VERTEX_SHADER,   p.vtxPath.c_str() },
+                { GL_FRAGMENT_SHADER, p.fragPath.c_str() }
+        };
+        p.program = submitProgram(p.shaders, request.features);
+    }
+
+    chrono::duration<double> submitted = chrono::high_resolution_clock::now() - batchStart;
+    submitSeconds = submitted.count();
+    readySeconds = 0;
+}
+
+bool pollShaders() {
+    for (auto it = pending.begin(); it != pending.end(); ) {
+        GLint done = GL_TRUE;
+        if (it->second.program) glGetProgramiv(it->second.program, GL_COMPLETION_STATUS_KHR, &done);
+        if (done) finishPending(it++);
+        else ++it;
+    }
+    return pending.empty();
+}
+
+void finishShaders() {
+    while (!pending.empty())
+        finishPending(pending.begin());
+}
+
+void reportShaderSetup() {
+    finishShaders();
+    cout << "Shader setup: " << restoredPrograms << " programs restored from binaries, "
+         << batchSize - restoredPrograms << " compiled " << (parallelCompile() ? "in parallel" : "sequentially")
+         << ", " << submitSeconds * 1000 << "ms to submit, all ready after " << readySeconds * 1000 << "ms" << endl;
+}
 
 // Load the requested shader program
-GLuint fetchShader(string vtx, string frag) {
-    vtx = "src/shaders/" + vtx;
-    frag = "src/shaders/" + frag;
+GLuint fetchShader(string vtx, string frag, unsigned int features) {
+    auto key = make_tuple(vtx, frag, features);
+    auto cached = programs.find(key);
+    if (cached != programs.end()) return cached->second;
+
+    // Submitted by compileShaders, so only wait for this one
+    auto submitted = pending.find(key);
+    if (submitted != pending.end()) return finishPending(submitted);
+
+    if (GLuint program = restoreProgram(key)) return registerProgram(key, program);
+
+    string vtxPath = SHADER_DIR + vtx;
+    string fragPath = SHADER_DIR + frag;
     vector<ShaderInfo> shaders = {
-            { GL_VERTEX_SHADER,   vtx.c_str() },
-            { GL_FRAGMENT_SHADER, frag.c_str() }
+            { GL_VERTEX_SHADER,   vtxPath.c_str() },
+            { GL_FRAGMENT_SHADER, fragPath.c_str() }
+    };
+    return registerProgram(key, loadShaders(shaders, features));
+}
+
+GLuint fetchShaderVariant(GLuint program, unsigned int features) {
+    auto it = variants.find(program);
+    if (it == variants.end()) return program;
+    return fetchShader(it->second.vtx, it->second.frag, features);
+}
+
+unsigned int shaderFeatures(GLuint program) {
+    auto it = variants.find(program);
+    return (it == variants.end()) ? 0 : it->second.features;
+}
+
+void deleteShaders() {
+    finishShaders();
+    for (auto& it : programs)
+        if (it.second) glDeleteProgram(it.second);
+    programs.clear();
+    variants.clear();
+}
+
+/*************************************************************
+                       Variant profiling
+ *************************************************************/
+
+struct ShaderQuery {
+    GLuint program;
+    GLuint time;
+    GLuint fragments;   // 0 without ARB_pipeline_statistics_query
+};
+static bool profiling = false;
+static vector<ShaderQuery> queries;
+
+void setShaderProfiling(bool on) {
+    profiling = on;
+}
+
+void beginShaderQuery(GLuint program) {
+    if (!profiling) return;
+
+    ShaderQuery query = { program, 0, 0 };
+    glGenQueries(1, &query.time);
+    glBeginQuery(GL_TIME_ELAPSED, query.time);
+    if (GLAD_GL_ARB_pipeline_statistics_query) {
+        glGenQueries(1, &query.fragments);
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, query.fragments);
+    }
+    queries.push_back(query);
+}
+
+void endShaderQuery() {
+    if (!profiling) return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    if (GLAD_GL_ARB_pipeline_statistics_query) glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+}
+
+void reportShaderCosts() {
+    struct Cost {
+        GLuint64 nanoseconds = 0;
+        GLuint64 fragments = 0;
+        int draws = 0;
     };
-    return loadShaders(shaders);
+    map<GLuint, Cost> costs;
+    for (auto& query : queries) {
+        Cost& cost = costs[query.program];
+        GLuint64 result = 0;
+        glGetQueryObjectui64v(query.time, GL_QUERY_RESULT, &result);
+        cost.nanoseconds += result;
+        if (query.fragments) {
+            glGetQueryObjectui64v(query.fragments, GL_QUERY_RESULT, &result);
+            cost.fragments += result;
+        }
+        cost.draws++;
+
+        glDeleteQueries(1, &query.time);
+        if (query.fragments) glDeleteQueries(1, &query.fragments);
+    }
+    queries.clear();
+    profiling = false;
+
+    cout << "Shader variant costs (1 frame):" << endl;
+    for (auto& it : costs) {
+        auto variant = variants.find(it.first);
+        string name = (variant == variants.end()) ? "program " + to_string(it.first)
+                      : variant->second.frag + " [" + featureString(variant->second.features) + "]";
+        cout << "  " << name << ": " << it.second.draws << " draws, " << it.second.nanoseconds / 1000 << "us";
+        if (it.second.fragments)
+            cout << ", " << it.second.fragments << " fragments, "
+                 << double(it.second.nanoseconds) / it.second.fragments << "ns/fragment";
+        cout << endl;
+    }
 }
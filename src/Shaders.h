@@ -1,6 +1,8 @@
 #ifndef OPENGL_SHADERS_H
 #define OPENGL_SHADERS_H
 
+#include "Glad.h"
+
 #include <vector>
 #include <string>
 
@@ -10,8 +12,48 @@ typedef struct {
     GLuint       shader;
 } ShaderInfo;
 
-GLuint loadShaders( std::vector<ShaderInfo>& );
+// Optional features that are compiled into a shader variant (each is #defined under the same name
+// without the prefix, ie SHADER_LIT -> #define LIT), instead of being branched on per fragment
+enum ShaderFeature {
+    SHADER_LIT          = 1 << 0,   // Phong lighting from the scene's light source
+    SHADER_TEXTURED     = 1 << 1,   // sample a diffuse texture
+    SHADER_VERTEX_COLOR = 1 << 2,   // per-vertex colors
+    SHADER_SPECULAR_MAP = 1 << 3,   // sample a specular texture
+    SHADER_ALPHA_TEST   = 1 << 4,   // discard fragments whose diffuse alpha is below alphaCutoff
+};
+
+GLuint loadShaders( std::vector<ShaderInfo>&, unsigned int features = 0 );
+
+// Returns the cached program for this pair of shaders & set of features, compiling it the first time
+GLuint fetchShader(std::string, std::string, unsigned int features = 0);
+
+// A program to compile ahead of time
+struct ShaderRequest {
+    std::string vtx;
+    std::string frag;
+    unsigned int features;
+};
+
+// Submits every program in the batch before checking any of them, so that a driver with
+// KHR_parallel_shader_compile can build them on its own threads (without it they're compiled one by one).
+// fetchShader only waits for the program it asks for
+void compileShaders(const std::vector<ShaderRequest>&);
+bool pollShaders();         // moves the programs the driver has finished into the cache without blocking; true once all are
+void finishShaders();       // waits for the rest
+void reportShaderSetup();   // waits for the rest & prints how long the last batch took
+
+// The same shaders as a program returned by fetchShader, with a different set of features
+GLuint fetchShaderVariant(GLuint program, unsigned int features);
+unsigned int shaderFeatures(GLuint program);
+
+// Deletes every cached program (the objects using them must be gone)
+void deleteShaders();
 
-GLuint fetchShader(std::string, std::string);
+// GPU cost of each variant: while profiling is on, the draws between beginShaderQuery & endShaderQuery are
+// timed (& their fragment shader invocations counted, if ARB_pipeline_statistics_query is supported)
+void setShaderProfiling(bool);
+void beginShaderQuery(GLuint program);
+void endShaderQuery();
+void reportShaderCosts();   // waits for the results & prints them
 
 #endif
@@ -0,0 +1,127 @@
+#include "Snapshot.h"
+#include "Archive.h"
+#include "Assets.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const uint32_t SNAPSHOT_MAGIC = 0x50414e53;     // "SNAP"
+static const uint32_t SNAPSHOT_VERSION = 1;     // bump when a cooked format changes (or a setting baked into one, ie the LODs)
+static const char* SOURCES_KEY = "sources";     // the files the snapshot was built from & their stamps
+
+static MappedArchive snapshot;
+static string snapshotPath;
+
+// The snapshot being recorded
+static bool recording = false;
+static mutex recordLock;
+static vector<ArchiveInput> recorded;
+static set<string> recordedKeys;
+static map<string, pair<int64_t, int64_t>> sources;    // path -> size & mtime
+
+// Every source must still have the stamp it had when the snapshot was built
+static bool upToDate() {
+    SnapshotReader reader;
+    if (!findSnapshot(SOURCES_KEY, reader)) return false;
+
+    uint32_t count = reader.read<uint32_t>();
+    for (uint32_t i = 0; i < count && reader.ok(); i++) {
+        string path = reader.readString();
+        int64_t size = reader.read<int64_t>();
+        int64_t mtime = reader.read<int64_t>();
+
+        int64_t currentSize, currentMTime;
+        if (!assetStamp(path, currentSize, currentMTime) || currentSize != size || currentMTime != mtime) return false;
+    }
+    return reader.ok();
+}
+
+bool openSnapshot(const string& path) {
+    closeSnapshot();
+    snapshotPath = path;
+
+    if (mapArchive(path, SNAPSHOT_MAGIC, SNAPSHOT_VERSION, snapshot)) {
+        if (upToDate()) {
+            // Everything in it is about to be uploaded, so start paging it all in now
+            madvise((void*) snapshot.data, snapshot.size, MADV_WILLNEED);
+            return true;
+        }
+        unmapArchive(snapshot);
+    }
+
+    recording = true;
+    return false;
+}
+
+void closeSnapshot() {
+    unmapArchive(snapshot);
+
+    lock_guard<mutex> guard(recordLock);
+    recording = false;
+    recorded.clear();
+    recordedKeys.clear();
+    sources.clear();
+}
+
+bool snapshotRestoring() {
+    return snapshot.data != nullptr;
+}
+
+bool snapshotRecording() {
+    return recording;
+}
+
+bool findSnapshot(const string& key, SnapshotReader& reader) {
+    const ArchiveEntry* entry = findArchiveEntry(snapshot, key);
+    if (!entry || (entry->flags & ARCHIVE_LZ4)) return false;
+
+    reader = SnapshotReader(snapshot.data + entry->offset, entry->size);
+    return true;
+}
+
+void addSnapshot(const string& key, SnapshotWriter&& writer) {
+    lock_guard<mutex> guard(recordLock);
+    if (!recording || !recordedKeys.insert(key).second) return;    // the first copy of a shared resource wins
+
+    ArchiveInput input = { key, std::move(writer.data()), 0, 0, 0 };
+    input.size = input.data.size();
+    recorded.push_back(std::move(input));
+}
+
+void snapshotDepends(const string& path) {
+    lock_guard<mutex> guard(recordLock);
+    if (!recording || sources.count(path)) return;
+
+    int64_t size, mtime;
+    if (assetStamp(path, size, mtime)) sources[path] = make_pair(size, mtime);
+}
+
+void saveSnapshot() {
+    lock_guard<mutex> guard(recordLock);
+    if (!recording) return;
+
+    SnapshotWriter stamps;
+    stamps.write((uint32_t) sources.size());
+    for (auto& it : sources) {
+        stamps.write(it.first);
+        stamps.write(it.second.first);
+        stamps.write(it.second.second);
+    }
+    ArchiveInput input = { SOURCES_KEY, std::move(stamps.data()), 0, 0, 0 };
+    input.size = input.data.size();
+    recorded.push_back(std::move(input));
+
+    string dir = snapshotPath.substr(0, snapshotPath.find_last_of('/'));
+    if (dir != snapshotPath) mkdir(dir.c_str(), 0755);
+    writeArchive(snapshotPath, SNAPSHOT_MAGIC, SNAPSHOT_VERSION, recorded);
+
+    recording = false;
+    recorded.clear();
+    recordedKeys.clear();
+    sources.clear();
+}
@@ -0,0 +1,89 @@
+#ifndef OPENGL_SNAPSHOT_H
+#define OPENGL_SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// A baked copy of everything the scene builds while loading (cooked terrain & meshes, filtered mip chains,
+// program binaries & the compiled scene description), kept in one file in the archive format (see Archive.h).
+// Each loader looks its key up first & restores straight out of the mapped file; if the snapshot is
+// missing or out of date, the loaders record what they build instead & the scene saves it once it's loaded.
+// The snapshot is out of date when its version differs or any file it was built from has changed
+
+// Appends the fields of an entry
+class SnapshotWriter {
+    std::vector<unsigned char> _data;
+
+public:
+    void append(const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*) data;
+        _data.insert(_data.end(), bytes, bytes + size);
+    };
+    template <typename T> void write(const T& value) { append(&value, sizeof(T)); };
+    void write(const std::string& s) {
+        write((uint32_t) s.size());
+        append(s.data(), s.size());
+    };
+    void align(size_t alignment) { _data.resize((_data.size() + alignment - 1) / alignment * alignment, 0); };
+
+    std::vector<unsigned char>& data() { return _data; };
+};
+
+// Reads them back in the same order. Every read is bounds checked: reading past the end of the
+// entry returns zeros & makes ok() false, so callers only check once at the end
+class SnapshotReader {
+    const unsigned char* _data;
+    size_t _size;
+    size_t _position;
+    bool _ok;
+
+public:
+    SnapshotReader(const unsigned char* data = nullptr, size_t size = 0) :
+            _data(data), _size(size), _position(0), _ok(data != nullptr) {};
+
+    // A pointer into the mapped snapshot (nullptr if the entry is too short)
+    const unsigned char* view(size_t size) {
+        if (!_ok || size > _size - _position) {
+            _ok = false;
+            return nullptr;
+        }
+        const unsigned char* result = _data + _position;
+        _position += size;
+        return result;
+    };
+    template <typename T> T read() {
+        T value = T();
+        if (const unsigned char* bytes = view(sizeof(T))) memcpy(&value, bytes, sizeof(T));
+        return value;
+    };
+    std::string readString() {
+        uint32_t length = read<uint32_t>();
+        const unsigned char* bytes = view(length);
+        return bytes ? std::string((const char*) bytes, length) : std::string();
+    };
+    void align(size_t alignment) { view((_position + alignment - 1) / alignment * alignment - _position); };
+
+    size_t remaining() const { return _ok ? _size - _position : 0; };
+    bool ok() const { return _ok; };
+};
+
+// Maps the snapshot if it's up to date (returns true), otherwise starts recording a new one
+bool openSnapshot(const std::string& path);
+void closeSnapshot();
+
+bool snapshotRestoring();
+bool snapshotRecording();
+
+// The entry saved under this key, if the snapshot was restored & has it
+bool findSnapshot(const std::string& key, SnapshotReader&);
+
+// While recording (both are thread safe, for the texture threads)
+void addSnapshot(const std::string& key, SnapshotWriter&&);
+void snapshotDepends(const std::string& path);     // a file the snapshot is built from (asset or shader source)
+
+// Writes the recording (if there is one) & stops recording
+void saveSnapshot();
+
+#endif //OPENGL_SNAPSHOT_H
@@ -0,0 +1,163 @@
+#include "TexturePacker.h"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+using namespace std;
+
+static const int ATLAS_SIZE = 2048;         // max width & height of an atlas page
+static const int ATLAS_MAX_IMAGE = 1024;    // textures bigger than this in either direction are never atlased
+static const int ATLAS_PADDING = 8;         // texels of edge-extended border around each image (a power of 2)
+
+// Where an atlased image's level 0 goes
+struct Placement {
+    int image;
+    int page;
+    int x, y;
+};
+
+static int alignUp(int v, int alignment) {
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+// Copy a level into an atlas page & extend its edges into the padding around it
+static void blitPadded(const MipLevel& src, MipLevel& dst, int x, int y, int padding, int channels) {
+    for (int dy = -padding; dy < src.height + padding; dy++) {
+        int ty = y + dy;
+        if (ty < 0 || ty >= dst.height) continue;
+        int sy = min(max(dy, 0), src.height - 1);
+
+        for (int dx = -padding; dx < src.width + padding; dx++) {
+            int tx = x + dx;
+            if (tx < 0 || tx >= dst.width) continue;
+            int sx = min(max(dx, 0), src.width - 1);
+
+            const unsigned char* s = &src.data[(sy * src.width + sx) * channels];
+            unsigned char* d = &dst.data[(ty * dst.width + tx) * channels];
+            copy(s, s + channels, d);
+        }
+    }
+}
+
+// Shelf-pack images with the same channel count into as few pages as possible
+static PackedArray buildAtlas(vector<MipChain>& images, const vector<int>& members, int arrayIndex,
+                              vector<PackedImage>& packed) {
+    // Tallest first keeps the shelves tight
+    vector<int> order(members);
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return images[a].height() > images[b].height(); });
+
+    vector<Placement> placements;
+    int page = 0, shelfY = 0, shelfHeight = 0, x = 0;
+    int usedWidth = 0, usedHeight = 0;
+    for (int i : order) {
+        int cellW = alignUp(images[i].width(), ATLAS_PADDING) + 2 * ATLAS_PADDING;
+        int cellH = alignUp(images[i].height(), ATLAS_PADDING) + 2 * ATLAS_PADDING;
+
+        if (x + cellW > ATLAS_SIZE) {       // next shelf
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+            x = 0;
+        }
+        if (shelfY + cellH > ATLAS_SIZE) {  // next page
+            page++;
+            shelfY = 0;
+            shelfHeight = 0;
+            x = 0;
+        }
+
+        placements.push_back({ i, page, x + ATLAS_PADDING, shelfY + ATLAS_PADDING });
+        x += cellW;
+        shelfHeight = max(shelfHeight, cellH);
+        usedWidth = max(usedWidth, x);
+        usedHeight = max(usedHeight, shelfY + shelfHeight);
+    }
+
+    // Every page is trimmed to the space that's used on any of them. Only the levels where the
+    // padding is still at least a texel wide are kept, so the images never bleed into each other
+    PackedArray array;
+    array.channels = images[members[0]].channels;
+    array.atlas = true;
+
+    int numLevels = 1;
+    for (int p = ATLAS_PADDING; p > 1 && (usedWidth >> numLevels) > 0 && (usedHeight >> numLevels) > 0; p /= 2)
+        numLevels++;
+
+    array.layers.resize(page + 1);
+    for (auto& layer : array.layers) {
+        layer.channels = array.channels;
+        for (int k = 0; k < numLevels; k++) {
+            MipLevel level;
+            level.width = max(1, usedWidth >> k);
+            level.height = max(1, usedHeight >> k);
+            level.data.assign(level.width * level.height * array.channels, 0);
+            layer.levels.push_back(std::move(level));
+        }
+    }
+
+    for (auto& p : placements) {
+        MipChain& image = images[p.image];
+        MipChain& layer = array.layers[p.page];
+        for (int k = 0; k < numLevels && k < image.levels.size(); k++)
+            blitPadded(image.levels[k], layer.levels[k], p.x >> k, p.y >> k, ATLAS_PADDING >> k, array.channels);
+
+        PackedImage& result = packed[p.image];
+        result.array = arrayIndex;
+        result.layer = p.page;
+        result.uvRect[0] = float(image.width()) / usedWidth;
+        result.uvRect[1] = float(image.height()) / usedHeight;
+        result.uvRect[2] = float(p.x) / usedWidth;
+        result.uvRect[3] = float(p.y) / usedHeight;
+
+        image = MipChain();     // its data now lives in the page
+    }
+    return array;
+}
+
+PackedTextures packTextures(vector<MipChain>& images, bool allowAtlas) {
+    PackedTextures result;
+    result.images.assign(images.size(), { -1, 0, { 1.0f, 1.0f, 0.0f, 0.0f } });
+
+    // Group the textures by format & size
+    map<tuple<int, int, int>, vector<int>> groups;
+    for (int i = 0; i < images.size(); i++)
+        if (images[i].valid()) groups[make_tuple(images[i].channels, images[i].width(), images[i].height())].push_back(i);
+
+    // Groups of the same size become arrays, small leftovers are atlas candidates (per channel count)
+    map<int, vector<int>> atlasCandidates;
+    for (auto& group : groups) {
+        auto& members = group.second;
+        int first = members[0];
+        bool small = images[first].width() <= ATLAS_MAX_IMAGE && images[first].height() <= ATLAS_MAX_IMAGE;
+        if (members.size() == 1 && allowAtlas && small) {
+            atlasCandidates[images[first].channels].push_back(first);
+            continue;
+        }
+
+        PackedArray array;
+        array.channels = images[first].channels;
+        array.atlas = false;
+        for (int i : members) {
+            result.images[i].array = result.arrays.size();
+            result.images[i].layer = array.layers.size();
+            array.layers.push_back(std::move(images[i]));
+        }
+        result.arrays.push_back(std::move(array));
+    }
+
+    for (auto& candidates : atlasCandidates) {
+        auto& members = candidates.second;
+        if (members.size() == 1) {
+            // Nothing to share a page with
+            int i = members[0];
+            result.images[i].array = result.arrays.size();
+            result.images[i].layer = 0;
+            result.arrays.push_back({ images[i].channels, false, {} });
+            result.arrays.back().layers.push_back(std::move(images[i]));
+            continue;
+        }
+        result.arrays.push_back(buildAtlas(images, members, result.arrays.size(), result.images));
+    }
+
+    return result;
+}
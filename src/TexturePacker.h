@@ -0,0 +1,37 @@
+#ifndef OPENGL_TEXTUREPACKER_H
+#define OPENGL_TEXTUREPACKER_H
+
+#include "Mipmaps.h"
+
+#include <vector>
+
+// Groups decoded textures into GL_TEXTURE_2D_ARRAY layers so that objects using different
+// textures can share one bind:
+//  - textures with the same size & channel count become layers of one array
+//  - small textures that match nothing else are packed into padded atlas pages (which are themselves
+//    layers of one array), if atlasing is allowed - it isn't for repeating textures, since the
+//    wrapping would sample the neighbouring images
+//  - anything else gets an array of its own with a single layer
+
+// Where an image ended up
+struct PackedImage {
+    int array;          // index into PackedTextures::arrays (-1 if the image was invalid)
+    int layer;
+    float uvRect[4];    // scale (xy) & offset (zw) that map the image's [0, 1] UVs into the layer
+};
+
+struct PackedArray {
+    int channels;
+    bool atlas;
+    std::vector<MipChain> layers;       // every layer has the same size & number of levels
+};
+
+struct PackedTextures {
+    std::vector<PackedArray> arrays;
+    std::vector<PackedImage> images;    // in the same order as the input
+};
+
+// Consumes the chains (they're moved into the arrays)
+PackedTextures packTextures(std::vector<MipChain>& images, bool allowAtlas);
+
+#endif //OPENGL_TEXTUREPACKER_H
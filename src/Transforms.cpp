@@ -0,0 +1,181 @@
+#include "Transforms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+/*************************************************************
+                     4-wide SIMD helpers
+ *************************************************************/
+
+// GCC & Clang vector extensions, which compile to SSE on x86 & NEON on ARM
+typedef float float4 __attribute__((vector_size(16)));
+typedef int32_t int4 __attribute__((vector_size(16)));
+
+static inline float4 load(const float* p) {
+    float4 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store(float* p, float4 v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline float4 splat(float f) {
+    float4 v = { f, f, f, f };
+    return v;
+}
+
+// Lanes of a where the mask (a comparison's result) is set, of b elsewhere
+static inline float4 select(int4 mask, float4 a, float4 b) {
+    return (float4) ((mask & (int4) a) | (~mask & (int4) b));
+}
+
+// Sine of x in [-pi, pi], folded onto [-pi/2, pi/2] where the Taylor series to x^11 is within 1e-7
+static inline float4 sin4(float4 x) {
+    const float4 halfPi = splat(1.57079632679f), pi = splat(3.14159265359f);
+    x = select(x > halfPi, pi - x, x);
+    x = select(x < -halfPi, -pi - x, x);
+
+    float4 x2 = x * x;
+    float4 p = splat(-1.0f / 39916800.0f);
+    p = p * x2 + splat(1.0f / 362880.0f);
+    p = p * x2 + splat(-1.0f / 5040.0f);
+    p = p * x2 + splat(1.0f / 120.0f);
+    p = p * x2 + splat(-1.0f / 6.0f);
+    p = p * x2 + splat(1.0f);
+    return p * x;
+}
+
+// Both of any angle: reduced to [-pi, pi] by the nearest multiple of 2 pi (in two parts, so that the large multiples
+// don't lose the low bits) & cos(x) = sin(pi/2 - x), folded back into [-pi, pi]
+static inline void sincos4(float4 x, float4& s, float4& c) {
+    const float4 pi = splat(3.14159265359f), halfPi = splat(1.57079632679f);
+    float4 half = select(x < splat(0.0f), splat(-0.5f), splat(0.5f));
+    float4 k = __builtin_convertvector(__builtin_convertvector(x * splat(0.159154943092f) + half, int4), float4);
+    x = (x - k * splat(6.28125f)) - k * splat(0.00193530717958647f);
+
+    s = sin4(x);
+    float4 y = halfPi - x;
+    c = sin4(select(y > pi, y - splat(6.28318530718f), y));
+}
+
+/*************************************************************
+                          Store
+ *************************************************************/
+
+TransformStore::TransformStore() : _count(0) {}
+
+// Adds LANES slots to every array
+void TransformStore::grow() {
+    size_t size = _x.size() + LANES;
+    for (auto array : { &_x, &_y, &_z, &_scale, &_axisX, &_axisY, &_axisZ, &_angle, &_spin, &_start,
+                        &_centerX, &_centerY, &_centerZ, &_radius, &_worldX, &_worldY, &_worldZ, &_worldRadius })
+        array->resize(size, 0.0f);
+    for (auto& it : _model)
+        it.resize(size, 0.0f);
+    _visible.resize(size, 0);
+}
+
+uint32_t TransformStore::add(double startTime) {
+    uint32_t i;
+    if (!_free.empty()) {
+        i = _free.back();
+        _free.pop_back();
+    } else {
+        if (_count == _x.size()) grow();
+        i = _count++;
+    }
+
+    _x[i] = _y[i] = _z[i] = 0.0f;
+    _scale[i] = 1.0f;
+    _axisX[i] = _axisY[i] = _axisZ[i] = 0.0f;
+    _angle[i] = _spin[i] = 0.0f;
+    _start[i] = (float) startTime;
+    _centerX[i] = _centerY[i] = _centerZ[i] = _radius[i] = 0.0f;
+    return i;
+}
+
+void TransformStore::remove(uint32_t i) {
+    _free.push_back(i);
+}
+
+void TransformStore::setRotation(uint32_t i, glm::vec3 axis, float speed) {
+    float length = sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+    if (length == 0.0f) {
+        _axisX[i] = _axisY[i] = _axisZ[i] = _angle[i] = _spin[i] = 0.0f;
+        return;
+    }
+
+    _axisX[i] = axis.x / length;
+    _axisY[i] = axis.y / length;
+    _axisZ[i] = axis.z / length;
+
+    // Not spinning -> static rotation so the object simply faces the axis (the angle between it & +Z)
+    _angle[i] = (speed != 0.0f) ? 0.0f : acos(_axisZ[i]);
+    _spin[i] = speed * 2.0f * (float) M_PI;
+}
+
+void TransformStore::setBounds(uint32_t i, glm::vec3 center, float radius) {
+    _centerX[i] = center.x;
+    _centerY[i] = center.y;
+    _centerZ[i] = center.z;
+    _radius[i] = radius;
+}
+
+float TransformStore::rotationSpeed(uint32_t i) {
+    return _spin[i] / (2.0f * (float) M_PI);
+}
+
+glm::mat4 TransformStore::model(uint32_t i) {
+    return glm::mat4(glm::vec4(_model[0][i], _model[1][i], _model[2][i], 0.0f),
+                     glm::vec4(_model[3][i], _model[4][i], _model[5][i], 0.0f),
+                     glm::vec4(_model[6][i], _model[7][i], _model[8][i], 0.0f),
+                     glm::vec4(_model[9][i], _model[10][i], _model[11][i], 1.0f));
+}
+
+// translate * rotate (about the axis, like glm::rotate) * scale, then the bounding sphere & its frustum test
+void TransformStore::update(size_t begin, size_t end, double time, const glm::vec4* frustum) {
+    float4 now = splat((float) time);
+    float4 one = splat(1.0f);
+
+    for (size_t i = begin; i < end; i += LANES) {
+        float4 s, c;
+        sincos4(load(&_angle[i]) + load(&_spin[i]) * (now - load(&_start[i])), s, c);
+
+        float4 ax = load(&_axisX[i]), ay = load(&_axisY[i]), az = load(&_axisZ[i]);
+        float4 tx = (one - c) * ax, ty = (one - c) * ay, tz = (one - c) * az;
+        float4 scale = load(&_scale[i]);
+
+        float4 m[12] = {
+            (c + tx * ax) * scale,  (tx * ay + s * az) * scale, (tx * az - s * ay) * scale,
+            (ty * ax - s * az) * scale, (c + ty * ay) * scale,  (ty * az + s * ax) * scale,
+            (tz * ax + s * ay) * scale, (tz * ay - s * ax) * scale, (c + tz * az) * scale,
+            load(&_x[i]), load(&_y[i]), load(&_z[i]),
+        };
+        for (int k = 0; k < 12; k++)
+            store(&_model[k][i], m[k]);
+
+        float4 cx = load(&_centerX[i]), cy = load(&_centerY[i]), cz = load(&_centerZ[i]);
+        float4 wx = m[9] + m[0] * cx + m[3] * cy + m[6] * cz;
+        float4 wy = m[10] + m[1] * cx + m[4] * cy + m[7] * cz;
+        float4 wz = m[11] + m[2] * cx + m[5] * cy + m[8] * cz;
+        float4 radius = load(&_radius[i]) * scale;
+        store(&_worldX[i], wx);
+        store(&_worldY[i], wy);
+        store(&_worldZ[i], wz);
+        store(&_worldRadius[i], radius);
+
+        int4 inside = { -1, -1, -1, -1 };
+        for (int p = 0; p < 6; p++) {
+            const glm::vec4& plane = frustum[p];
+            float4 distance = splat(plane.x) * wx + splat(plane.y) * wy + splat(plane.z) * wz + splat(plane.w);
+            inside &= (distance >= -radius);
+        }
+        for (size_t k = 0; k < LANES; k++)
+            _visible[i + k] = inside[k] ? 1 : 0;
+    }
+}
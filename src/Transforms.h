@@ -0,0 +1,70 @@
+#ifndef OPENGL_TRANSFORMS_H
+#define OPENGL_TRANSFORMS_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// The transforms & bounds of every object in the scene, stored as structure of arrays (one array per field) so that
+// the per-frame update is a linear pass over a few packed arrays, 4 objects at a time in SIMD registers, instead of
+// a pointer chase over the objects. Objects keep an index into the store (see Object::_transform).
+// Rotations are about the object's axis: either spinning at a constant speed from when the object was created, or
+// fixed at the angle that faces the axis (see setRotation)
+class TransformStore {
+    // Every array is padded to a multiple of LANES so that the update never needs a scalar tail
+    static const size_t LANES = 4;
+
+    // Inputs
+    std::vector<float> _x, _y, _z;          // position
+    std::vector<float> _scale;
+    std::vector<float> _axisX, _axisY, _axisZ;      // normalized (all 0 for no rotation)
+    std::vector<float> _angle;              // radians at _start...
+    std::vector<float> _spin;               // ...& radians per second after it
+    std::vector<float> _start;              // scene clock
+    std::vector<float> _centerX, _centerY, _centerZ, _radius;      // bounding sphere (model space)
+
+    // Outputs of update: the model matrix's upper 3 rows (column-major, so the last 3 are the translation),
+    // the world space bounding sphere & whether it's in the view frustum
+    std::vector<float> _model[12];
+    std::vector<float> _worldX, _worldY, _worldZ, _worldRadius;
+    std::vector<uint8_t> _visible;
+
+    std::vector<uint32_t> _free;    // removed slots, reused by add
+    size_t _count;                  // slots in use or free
+
+    void grow();
+
+public:
+    TransformStore();
+
+    // A new transform at the origin (unscaled, unrotated & with an empty bounding sphere), created at this time
+    uint32_t add(double startTime);
+    void remove(uint32_t);
+
+    // Modifiers
+    void setPosition(uint32_t i, glm::vec3 p) { _x[i] = p.x; _y[i] = p.y; _z[i] = p.z; };
+    void setScale(uint32_t i, float s) { _scale[i] = s; };
+    void setRotation(uint32_t i, glm::vec3 axis, float speed);    // in revolutions per second, 0 to face the axis
+    void setBounds(uint32_t i, glm::vec3 center, float radius);
+
+    // Accessors
+    glm::vec3 position(uint32_t i) { return glm::vec3(_x[i], _y[i], _z[i]); };
+    float scale(uint32_t i) { return _scale[i]; };
+    float rotationSpeed(uint32_t i);
+
+    // As of the last update
+    glm::mat4 model(uint32_t i);
+    glm::vec3 worldCenter(uint32_t i) { return glm::vec3(_worldX[i], _worldY[i], _worldZ[i]); };
+    float worldRadius(uint32_t i) { return _worldRadius[i]; };
+    bool visible(uint32_t i) { return _visible[i] != 0; };
+
+    // Slots to update (removed ones are updated too, & ignored)
+    size_t size() { return _count; };
+
+    // Recomputes the outputs of the slots in [begin, end) at this time against the frustum's 6 planes
+    // (pointing inwards). begin must be a multiple of 4: ranges that are can be updated on different threads
+    void update(size_t begin, size_t end, double time, const glm::vec4* frustum);
+};
+
+#endif //OPENGL_TRANSFORMS_H
@@ -0,0 +1,68 @@
+#include "VertexFormat.h"
+
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cmath>
+
+Quantization quantizationFor(const float* positions, size_t count, size_t stride) {
+    Quantization q;
+    if (count == 0) return q;
+
+    glm::vec3 lo(positions[0], positions[1], positions[2]);
+    glm::vec3 hi = lo;
+    for (size_t i = 1; i < count; i++) {
+        const float* p = (const float*) ((const char*) positions + i * stride);
+        glm::vec3 v(p[0], p[1], p[2]);
+        lo = glm::min(lo, v);
+        hi = glm::max(hi, v);
+    }
+
+    q.offset = (lo + hi) * 0.5f;
+    q.scale = (hi - lo) * 0.5f;
+    for (int i = 0; i < 3; i++)
+        if (q.scale[i] <= 0.0f) q.scale[i] = 1.0f;  // flat along this axis - any scale works
+    return q;
+}
+
+static int16_t toSnorm16(float v) {
+    return (int16_t) std::lround(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f);
+}
+
+void packPosition(const glm::vec3& p, const Quantization& q, int16_t out[4]) {
+    glm::vec3 n = (p - q.offset) / q.scale;
+    out[0] = toSnorm16(n.x);
+    out[1] = toSnorm16(n.y);
+    out[2] = toSnorm16(n.z);
+    out[3] = 0;
+}
+
+// Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half over the upper half
+void packNormal(const glm::vec3& n, int16_t out[2]) {
+    float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (sum == 0.0f) {
+        out[0] = out[1] = 0;
+        return;
+    }
+    float x = n.x / sum;
+    float y = n.y / sum;
+    if (n.z < 0.0f) {
+        float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+    out[0] = toSnorm16(x);
+    out[1] = toSnorm16(y);
+}
+
+uint32_t packNormal1010102(const glm::vec3& n) {
+    auto component = [](float v) {
+        int i = (int) std::lround(std::min(std::max(v, -1.0f), 1.0f) * 511.0f);
+        return (uint32_t) i & 0x3ff;
+    };
+    return component(n.x) | (component(n.y) << 10) | (component(n.z) << 20);
+}
+
+uint16_t packHalf(float f) {
+    return glm::packHalf1x16(f);
+}
@@ -0,0 +1,37 @@
+#ifndef OPENGL_VERTEXFORMAT_H
+#define OPENGL_VERTEXFORMAT_H
+
+#include "Glad.h"
+
+#include <cstdint>
+#include <cstddef>
+
+// Compact vertex encodings:
+//  - positions: 16-bit snorm, dequantized in the vertex shader as (p * posScale + posOffset)
+//  - normals:   octahedral encoding in 2 x 16-bit snorm, decoded in the vertex shader
+//  - UVs:       half floats (the GPU converts these itself)
+
+// Maps snorm positions in [-1, 1] back to the mesh's bounding box
+struct Quantization {
+    glm::vec3 scale;
+    glm::vec3 offset;
+
+    Quantization() : scale(1.0f), offset(0.0f) {};
+};
+
+// Replaces the 32 byte Mesh::Vertex (position is padded to 4 components to keep attributes 4-byte aligned)
+struct CompactVertex {
+    int16_t position[4];
+    int16_t normal[2];
+    uint16_t texCoords[2];
+};
+
+// Finds the bounding box of `count` positions spaced `stride` bytes apart
+Quantization quantizationFor(const float* positions, size_t count, size_t stride);
+
+void packPosition(const glm::vec3&, const Quantization&, int16_t out[4]);
+void packNormal(const glm::vec3&, int16_t out[2]);     // octahedral
+uint32_t packNormal1010102(const glm::vec3&);          // for GL_INT_2_10_10_10_REV attributes
+uint16_t packHalf(float);
+
+#endif //OPENGL_VERTEXFORMAT_H
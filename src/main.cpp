@@ -1,17 +1,32 @@
 #include "Scene.h"
+#include "Latency.h"
+#include "Profiler.h"
 
+#include <algorithm>
+#include <chrono>
 #include <thread>
 
 using namespace std;
 
+/********* Configurable settings *********/
+static const double TIMESTEP = 1.0 / 60.0;     // seconds of simulation per step, whatever the frame rate
+static const double MAX_FRAME_TIME = 0.25;     // longer frames (ie a stall) are only simulated up to this
+static const bool VSYNC = true;                // otherwise the frame rate is uncapped
+static const int MAX_QUEUED_FRAMES = 1;        // frames the GPU can be behind when the render thread takes the next
+static const std::string STARTUP_TRACE_PATH = "cache/startup.json";     // the profiler's zones while loading (debug)
+/*****************************************/
+
 // Forward declarations
 GLFWwindow* initWindow();
+static void renderLoop(GLFWwindow*, Scene*, FrameExchange*);
 static void cursorPositionCallback(GLFWwindow*, double, double);
 void scrollCallback(GLFWwindow*, double, double);
 void keyCallback(GLFWwindow*, int, int, int, int);
 void handleRepeatInput (Scene&, GLFWwindow*);
 
 int main(int argc, char** argv) {
+    PROFILE_THREAD("Main");
+
     // Initialize GLFW & the window context
     glfwInit();
     GLFWwindow* window = initWindow();
@@ -28,13 +43,11 @@ int main(int argc, char** argv) {
     }
     cout << "Created OpenGL " << GLVersion.major  << "." <<  GLVersion.minor << " context" <<  endl;
 
-    // Define desired frame rate
-    int FPS = 60;
-
     // Initialize the scene with the initial cursor position
     double xpos, ypos;
     glfwGetCursorPos(window, &xpos, &ypos);
     Scene scene(xpos, ypos);
+    if (DEBUG && writeStartupTrace(STARTUP_TRACE_PATH)) cout << "Wrote the startup trace to " << STARTUP_TRACE_PATH << endl;
 
     // Pass the scene to GLFW so it can be accessed from the input callbacks
     glfwSetWindowUserPointer(window, &scene);
@@ -47,30 +60,49 @@ int main(int argc, char** argv) {
     // Capture the cursor
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // Enter the rendering loop
+    // Hand the context over to the render thread, which draws the frames this thread simulates
+    // (GLFW's events have to be handled on the main thread)
+    FrameExchange exchange;
+    glfwMakeContextCurrent(nullptr);
+    thread renderer(renderLoop, window, &scene, &exchange);
+
+    // Enter the simulation loop: the simulation runs in fixed steps to catch up with the real time
+    // (so it's the same at any frame rate) & each frame is drawn between the last two steps
+    auto previous = chrono::high_resolution_clock::now();
+    double accumulator = 0;
     while( !glfwWindowShouldClose(window) ) {
-        auto loopStart = chrono::high_resolution_clock::now();
+        // Wait for the render thread to free a packet first, so the input is sampled as late as possible before
+        // the frame is built from it (rather than before a wait for the frame ahead to be drawn)
+        FramePacket* frame = exchange.beginFrame();
+        if (frame == nullptr) break;
+        PROFILE_ZONE("Simulate");
 
-        // Draw the scene
-        try {
-            scene.draw();
-        } catch (EndProgramException e) {
-            std::cerr << e.what() << std::endl;
-            std::cout << "Ending program due to erroneous state..." << std::endl;
-            glfwSetWindowShouldClose(window, GLFW_TRUE);
-        }
-        glfwSwapBuffers(window);
+        auto now = chrono::high_resolution_clock::now();
+        chrono::duration<double> frameTime = now - previous;
+        previous = now;
+        accumulator += min(frameTime.count(), MAX_FRAME_TIME);
 
         // Poll for events
         glfwPollEvents();
-        handleRepeatInput(scene, window);
 
-        // Pause for an appropriate amount of time to achieve desired frame rate
-        auto msPerFrame = int (1.0 / (FPS / 1000.0));
-        this_thread::sleep_until(loopStart + chrono::milliseconds(msPerFrame));
-        scene.Tick();
+        while (accumulator >= TIMESTEP) {
+            handleRepeatInput(scene, window);
+            scene.Step(TIMESTEP);
+            accumulator -= TIMESTEP;
+        }
+        scene.Interpolate(accumulator / TIMESTEP);
+
+        // Hand the frame over to be drawn while the next one is simulated
+        scene.buildFrame(*frame);
+        frame->inputs = takeInputEvents();
+        exchange.publish();
     }
 
+    exchange.close();
+    renderer.join();
+    glfwMakeContextCurrent(window);
+
+    reportLatency();
     glfwTerminate();
     std::cout << "Goodbye!" << std::endl;
     return  0;
@@ -80,12 +112,54 @@ int main(int argc, char** argv) {
                          Helpers
  *************************************************************/
 
+// The render thread owns the context: it draws each packet the simulation publishes, in order
+static void renderLoop(GLFWwindow* window, Scene* scene, FrameExchange* exchange) {
+    PROFILE_THREAD("Render");
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(VSYNC ? 1 : 0);
+
+    while (true) {
+        PROFILE_FRAME();
+
+        // Keep the GPU no more than MAX_QUEUED_FRAMES behind (see Latency.h)
+        {
+            PROFILE_ZONE("Wait for GPU");
+            waitForFrames(MAX_QUEUED_FRAMES);
+        }
+
+        const FramePacket* frame;
+        {
+            PROFILE_ZONE("Wait for packet");
+            frame = exchange->acquire();
+        }
+        if (frame == nullptr) break;
+
+        // Draw the scene
+        try {
+            scene->draw(*frame);
+        } catch (EndProgramException e) {
+            std::cerr << e.what() << std::endl;
+            std::cout << "Ending program due to erroneous state..." << std::endl;
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+        {
+            PROFILE_ZONE("Swap");
+            glfwSwapBuffers(window);
+        }
+        frameSwapped(InputTimes(frame->inputs));
+        exchange->release();
+    }
+
+    glfwMakeContextCurrent(nullptr);
+}
+
 GLFWwindow* initWindow() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    glfwWindowHint(GLFW_SAMPLES, 4);     // multisampling, which alpha-to-coverage needs
 
     GLFWwindow* window = glfwCreateWindow(800, 800, "OpenGL Practice", nullptr, nullptr);
     return window;
@@ -93,17 +167,20 @@ GLFWwindow* initWindow() {
 
 // Mouse movement callback
 static void cursorPositionCallback(GLFWwindow* window, double xpos, double ypos) {
+    inputEvent();
     auto scene = reinterpret_cast<Scene*>(glfwGetWindowUserPointer(window));
     scene->Look(xpos, ypos);
 }
 
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
+    inputEvent();
     auto scene = reinterpret_cast<Scene*>(glfwGetWindowUserPointer(window));
     scene->Zoom(yoffset);
 }
 
 // Use callback to handle events that only occur once when a key is pressed
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    inputEvent();
     auto scene = reinterpret_cast<Scene*>(glfwGetWindowUserPointer(window));
     if (action == GLFW_PRESS) {
         switch (key) {
@@ -113,6 +190,18 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
             case GLFW_KEY_L:
                 scene->toggleLight();
                 break;
+            case GLFW_KEY_K:
+                scene->toggleLodPolicy();
+                break;
+            case GLFW_KEY_P:
+                scene->toggleDepthPrepass();
+                break;
+            case GLFW_KEY_I:
+                toggleLatencyTracking();
+                break;
+            case GLFW_KEY_T:
+                scene->requestTrace();
+                break;
             case GLFW_KEY_SPACE:
                 scene->Jump();
             default:break;
@@ -120,7 +209,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     }
 }
 
-// Use polling for events should continue to occur for as long as the key is being pressed
+// Use polling for events should continue to occur for as long as the key is being pressed (once per step)
 void handleRepeatInput (Scene& sc, GLFWwindow* window) {
     if (glfwGetKey(window, GLFW_KEY_A)) sc.Move(LEFT);
     if (glfwGetKey(window, GLFW_KEY_D)) sc.Move(RIGHT);
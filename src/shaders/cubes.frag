@@ -0,0 +1,22 @@
+#version 330 core
+
+#ifdef LIT
+#include "lighting.glsl"
+in vec3 Normal;
+in vec3 WorldCoords;
+#endif
+
+// Texture array data (see CubeBatch)
+uniform sampler2DArray sampleTextures;
+in vec3 TexCoords;
+
+out vec4 outColor;
+
+void main() {
+    outColor = texture(sampleTextures, TexCoords);
+
+#ifdef LIT
+    Lighting l = phong(Normal, WorldCoords, 0.5, 1.1, 1.2, 32.0);
+    outColor *= vec4(l.ambient + l.diffuse + l.specular, 1.0);
+#endif
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+// Depth pre-pass: the color writes are masked off, so there's nothing to do
+
+void main() {
+}
\ No newline at end of file
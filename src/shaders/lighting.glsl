@@ -0,0 +1,41 @@
+// Phong lighting from the scene's light source (included by the LIT variants)
+uniform vec3 lightColor;
+uniform vec3 lightPos;
+uniform vec3 viewPos;
+
+struct Lighting {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float lit;          // ambient + diffuse strength without the light's color (ie to scale alpha by)
+    float shine;        // the same for the specular
+};
+
+// Higher shine -> reflection is more "dense" (not diffused)
+Lighting phong(vec3 normal, vec3 worldCoords, float ambientStr, float diffStr, float specularStr, float shine) {
+    Lighting result;
+
+    /* 1) Ambient lighting */
+    result.ambient = ambientStr * lightColor;
+    result.lit = ambientStr;
+
+    /* 2) Diffuse lighting */
+    // Calculate direction between light source and fragment's position (world position)
+    vec3 norm = normalize(normal);
+    vec3 lightDir = normalize(lightPos - worldCoords);
+
+    // Calculate the diffuse light "impact" by taking the dot product of lightDir & the surface normal
+    float diffImpact = max(dot(norm, lightDir), 0.0);    // make sure the value is not negative
+    result.diffuse = diffStr * diffImpact * lightColor;
+    result.lit += diffStr * diffImpact;
+
+    /* 3) Specular lighting */
+    // Calculate the amount of reflection we'd see from our viewing position
+    vec3 viewDir = normalize(viewPos - worldCoords);
+    vec3 reflectDir = reflect(-lightDir, norm); // negative bc needs to be from light source to fragment
+    float specImpact = pow(max(dot(viewDir, reflectDir), 0.0), shine);
+    result.specular = specularStr * specImpact * lightColor;
+    result.shine = specularStr * specImpact;
+
+    return result;
+}
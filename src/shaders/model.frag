@@ -1,49 +1,53 @@
 #version 330 core
 
-// Lighting data
-uniform vec3 lightColor;
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-
+#ifdef LIT
+#include "lighting.glsl"
 in vec3 Normal;
-in vec2 TexCoords2D;
 in vec3 WorldCoords;
+#endif
+
+in vec2 TexCoords2D;
 
-uniform sampler2D diffuse_texture_0;
-uniform sampler2D specular_texture_0;
+// Each material's textures are a layer of a texture array shared by the model
+uniform sampler2DArray diffuse_texture_0;
+uniform float diffuse_texture_0_layer;
+#ifdef SPECULAR_MAP
+uniform sampler2DArray specular_texture_0;
+uniform float specular_texture_0_layer;
+#endif
 // add more when necessary
+#ifdef ALPHA_TEST
+uniform float alphaCutoff;
+#endif
 
 out vec4 outColor;
 
 void main() {
-    // If the object is not lit, just reture the diffuse texture color
-    if (lightColor == vec3(0.0)) {
-        outColor = texture(diffuse_texture_0, TexCoords2D);
-        return;
-    }
-
-    /* Configurable parameters */
-    float ambientStr = 0.4;
-    float diffStr = 1.0;
-    float specularStrength = 1.2;
-    float specularShine = 32;
-
-    /* 1) Ambient lighting */
-    vec4 ambient = ambientStr * vec4(lightColor, 1.0) * texture(diffuse_texture_0, TexCoords2D);
-
-    /* 2) Diffuse lighting */
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - WorldCoords);
-    float diffImpact = dot(norm, lightDir);
-    diffImpact = max(diffImpact, 0.0);
-    vec4 diffuse = diffStr * diffImpact * vec4(lightColor, 1.0) * texture(diffuse_texture_0, TexCoords2D);
-
-    /* 3) Specular lighting */
-    vec3 viewDir = normalize(viewPos - WorldCoords);
-    vec3 reflectDir = reflect(-lightDir, norm);
-    float specImpact = max(dot(viewDir, reflectDir), 0.0);
-    specImpact = pow(specImpact, specularShine);
-    vec4 specular = specularStrength * specImpact * vec4(lightColor, 1.0) * texture(specular_texture_0, TexCoords2D);
-
-    outColor = ambient + diffuse + specular;
-}
\ No newline at end of file
+    vec4 diffuseColor = texture(diffuse_texture_0, vec3(TexCoords2D, diffuse_texture_0_layer));
+#ifdef ALPHA_TEST
+    // Cut-out materials (foliage): with alpha-to-coverage the alpha below also sets the sample coverage
+    if (diffuseColor.a < alphaCutoff) discard;
+#endif
+
+#ifndef LIT
+    // If the object is not lit, just return the diffuse texture color
+    outColor = diffuseColor;
+#else
+    Lighting l = phong(Normal, WorldCoords, 0.4, 1.0, 1.2, 32.0);
+
+    // Blended materials' alpha is lit like their color (so they're more see-through in the shade), while cut-outs
+    // keep the texture's, which sets their coverage
+#ifdef ALPHA_TEST
+    float lit = 1.0, shine = 0.0;
+#else
+    float lit = l.lit, shine = l.shine;
+#endif
+    outColor = vec4(l.ambient + l.diffuse, lit) * diffuseColor;
+
+    // Without a specular map there's nothing to reflect
+#ifdef SPECULAR_MAP
+    vec4 specularColor = texture(specular_texture_0, vec3(TexCoords2D, specular_texture_0_layer));
+    outColor += vec4(l.specular, shine) * specularColor;
+#endif
+#endif
+}
@@ -0,0 +1,11 @@
+// Decoding the compact vertex format (see VertexFormat.h), included by the vertex shaders whose normals may be compact
+uniform bool compactVertices;
+uniform vec3 posScale;
+uniform vec3 posOffset;
+
+// Unfold an octahedral-encoded normal
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
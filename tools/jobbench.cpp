@@ -0,0 +1,153 @@
+// Measures the CPU side of a frame on the job system (see src/Jobs.h) with different numbers of threads
+//   usage: jobbench [objects] [max threads]
+// Each object does the work of Object::prepare (an animated model matrix, the MVP, a frustum test & a level of
+// detail pick), the blended tenth is then sorted back to front in a job that depends on them, like Scene::draw.
+// It doesn't need a GL context, so the numbers are only the CPU's share of the frame
+
+#include "../src/Jobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Configurable settings
+static const int WARMUP_FRAMES = 20;
+static const int FRAMES = 200;
+static const int NUM_LODS = 4;
+
+// Column-major like GLM, so the arithmetic matches what the scene's objects do
+struct Mat4 { float m[16]; };
+
+static Mat4 multiply(const Mat4& a, const Mat4& b) {
+    Mat4 r;
+    for (int col = 0; col < 4; col++)
+        for (int row = 0; row < 4; row++) {
+            float sum = 0;
+            for (int k = 0; k < 4; k++) sum += a.m[k * 4 + row] * b.m[col * 4 + k];
+            r.m[col * 4 + row] = sum;
+        }
+    return r;
+}
+
+// translate * rotate(angle, axis) * scale, as in Mesh::prepare
+static Mat4 modelMatrix(const float* position, const float* axis, float angle, float size) {
+    float c = cos(angle), s = sin(angle), t = 1 - c;
+    float x = axis[0], y = axis[1], z = axis[2];
+    Mat4 r = {{ (t * x * x + c) * size,     (t * x * y + s * z) * size, (t * x * z - s * y) * size, 0,
+                (t * x * y - s * z) * size, (t * y * y + c) * size,     (t * y * z + s * x) * size, 0,
+                (t * x * z + s * y) * size, (t * y * z - s * x) * size, (t * z * z + c) * size,     0,
+                position[0],                position[1],                position[2],                1 }};
+    return r;
+}
+
+struct Object {
+    float position[3];
+    float axis[3];
+    float speed;
+    float radius;
+    bool blended;
+
+    // Written by prepare
+    Mat4 mvp;
+    bool visible;
+    int lod;
+    float depth;
+};
+
+static void prepare(Object& o, const Mat4& viewProj, const float (&frustum)[6][4], float time) {
+    Mat4 model = modelMatrix(o.position, o.axis, time * o.speed * 6.2831853f, 1.0f);
+    o.mvp = multiply(viewProj, model);
+
+    o.visible = true;
+    for (auto& plane : frustum)
+        if (plane[0] * o.position[0] + plane[1] * o.position[1] + plane[2] * o.position[2] + plane[3] < -o.radius)
+            o.visible = false;
+
+    float distance = sqrt(o.position[0] * o.position[0] + o.position[1] * o.position[1] + o.position[2] * o.position[2]);
+    o.lod = min(NUM_LODS - 1, (int) (distance / 25.0f));
+    o.depth = o.mvp.m[15];     // clip space w of the origin, ie the distance in front of the camera
+}
+
+// A perspective projection looking down -z, & its frustum planes
+static void camera(Mat4& viewProj, float (&frustum)[6][4]) {
+    float f = 1.0f / tan(0.5f * 45.0f * 3.14159265f / 180.0f), near = 0.1f, far = 300.0f;
+    viewProj = {{ f, 0, 0, 0,   0, f, 0, 0,   0, 0, (far + near) / (near - far), -1,   0, 0, 2 * far * near / (near - far), 0 }};
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 4; j++) {
+            frustum[2 * i][j] = viewProj.m[j * 4 + 3] + viewProj.m[j * 4 + i];
+            frustum[2 * i + 1][j] = viewProj.m[j * 4 + 3] - viewProj.m[j * 4 + i];
+        }
+}
+
+int main(int argc, char** argv) {
+    size_t numObjects = (argc > 1) ? stoul(argv[1]) : 10000;
+    int maxThreads = (argc > 2) ? stoi(argv[2]) : (int) max(1u, thread::hardware_concurrency());
+
+    vector<Object> objects(numObjects);
+    mt19937 random(1);
+    uniform_real_distribution<float> coordinate(-100.0f, 100.0f), unit(0.0f, 1.0f);
+    for (auto& it : objects) {
+        it.position[0] = coordinate(random);
+        it.position[1] = coordinate(random) * 0.1f;
+        it.position[2] = coordinate(random);
+        float axis[3] = { unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f };
+        float length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]) + 1e-6f;
+        for (int i = 0; i < 3; i++) it.axis[i] = axis[i] / length;
+        it.speed = unit(random);
+        it.radius = 0.5f + unit(random);
+        it.blended = unit(random) < 0.1f;
+    }
+
+    Mat4 viewProj;
+    float frustum[6][4];
+    camera(viewProj, frustum);
+
+    cout << numObjects << " objects, " << thread::hardware_concurrency() << " hardware threads" << endl;
+    double singleThreaded = 0;
+    for (int threads = 1; threads <= maxThreads; threads = (threads < maxThreads) ? min(threads * 2, maxThreads) : threads + 1) {
+        JobSystem jobs(threads);
+        vector<double> times;
+        vector<pair<float, Object*>> blended;
+
+        // Kept across the frames like the scene's: once sorted is done, the thread that ran prepared's last job may
+        // still be releasing prepared's lock (after queueing the sort), so prepared mustn't go out of scope then
+        JobCounter prepared, sorted;
+        for (int frame = 0; frame < WARMUP_FRAMES + FRAMES; frame++) {
+            float time = frame / 60.0f;
+            auto start = chrono::high_resolution_clock::now();
+
+            jobs.parallelFor(objects.size(), 0, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) prepare(objects[i], viewProj, frustum, time);
+            }, prepared);
+            jobs.runAfter(prepared, [&] {
+                blended.clear();
+                for (auto& it : objects)
+                    if (it.blended && it.visible) blended.push_back(make_pair(it.depth, &it));
+                sort(blended.begin(), blended.end(),
+                     [](const pair<float, Object*>& a, const pair<float, Object*>& b) { return a.first > b.first; });
+            }, &sorted);
+            jobs.wait(sorted);
+
+            chrono::duration<double, milli> elapsed = chrono::high_resolution_clock::now() - start;
+            if (frame >= WARMUP_FRAMES) times.push_back(elapsed.count());
+        }
+
+        sort(times.begin(), times.end());
+        double mean = 0;
+        for (auto it : times) mean += it;
+        mean /= times.size();
+        if (threads == 1) singleThreaded = mean;
+
+        cout << threads << " thread" << (threads > 1 ? "s" : "") << ": " << mean << "ms mean, "
+             << times[times.size() / 2] << "ms median, " << times[times.size() * 95 / 100] << "ms p95 ("
+             << singleThreaded / mean << "x, " << blended.size() << " blended objects visible)" << endl;
+    }
+    return 0;
+}
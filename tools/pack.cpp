@@ -0,0 +1,94 @@
+// Packs asset directories into a single archive (see src/Archive.h for the layout)
+//   usage: pack <output> <directory>...
+// Entries are named by their path as given, ie `pack assets.pack assets` stores "assets/crate.jpeg"
+
+#include "../src/Archive.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Configurable settings
+static const double MIN_SAVING = 0.125;     // only keep the LZ4 version of a file if it's at least this much smaller
+
+static void listFiles(const string& dir, vector<string>& files) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        cerr << "Can't open directory " << dir << endl;
+        return;
+    }
+    while (dirent* entry = readdir(d)) {
+        if (entry->d_name[0] == '.') continue;  // ., .. & hidden files
+
+        string path = dir + "/" + entry->d_name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) continue;
+        if (S_ISDIR(info.st_mode)) listFiles(path, files);
+        else if (S_ISREG(info.st_mode)) files.push_back(path);
+    }
+    closedir(d);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        cerr << "usage: " << argv[0] << " <output> <directory>..." << endl;
+        return 1;
+    }
+
+    vector<string> files;
+    for (int i = 2; i < argc; i++) {
+        string dir = argv[i];
+        while (dir.size() > 1 && dir.back() == '/') dir.pop_back();
+        listFiles(dir, files);
+    }
+    sort(files.begin(), files.end());
+    files.erase(unique(files.begin(), files.end()), files.end());
+
+    // Read (& try compressing) every file
+    vector<ArchiveInput> inputs;
+    uint64_t totalSize = 0, totalStored = 0;
+    int compressed = 0;
+    for (auto& path : files) {
+        ifstream file(path, ios::binary);
+        stringstream contents;
+        contents << file.rdbuf();
+        string bytes = contents.str();
+
+        struct stat info;
+        stat(path.c_str(), &info);
+
+        ArchiveInput input = { path, {}, bytes.size(), (int64_t) info.st_mtime, 0 };
+        vector<unsigned char> lz4;
+        size_t lz4Size = lz4Compress((const unsigned char*) bytes.data(), bytes.size(), lz4);
+        if (lz4Size > 0 && lz4Size <= bytes.size() * (1.0 - MIN_SAVING)) {
+            input.data = std::move(lz4);
+            input.flags |= ARCHIVE_LZ4;
+            compressed++;
+        } else {
+            input.data.assign(bytes.begin(), bytes.end());
+        }
+
+        totalSize += input.size;
+        totalStored += input.data.size();
+        inputs.push_back(std::move(input));
+    }
+
+    string target = argv[1];
+    if (!writeArchive(target, ARCHIVE_MAGIC, ARCHIVE_VERSION, inputs)) {
+        cerr << "Failed writing " << target << endl;
+        return 1;
+    }
+
+    cout << "Packed " << inputs.size() << " files (" << compressed << " compressed) into " << target << ": "
+         << totalSize / 1024 << "KB -> " << totalStored / 1024 << "KB" << endl;
+    return 0;
+}
@@ -0,0 +1,51 @@
+// Measures what a profiler zone (see src/Profiler.h) costs the code it times
+//   usage: profilebench [zones]
+// Times a loop of empty zones against the same loop without them, nested 2 deep like a render() in Scene::draw,
+// & writes the last of them out as a trace to check the export. Also times the two tick reads each zone makes, which
+// are most of its cost (& cost several times as much in some virtual machines, where the counter is emulated)
+
+#include "../src/Profiler.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Configurable settings
+static const char* TRACE_PATH = "cache/profilebench.json";     // ignored by git, like the app's traces
+
+static volatile int sink = 0;
+
+int main(int argc, char** argv) {
+    long count = (argc > 1) ? stol(argv[1]) : 10000000;
+    PROFILE_THREAD("Main");
+
+    auto start = chrono::steady_clock::now();
+    for (long i = 0; i < count; i++)
+        sink = sink + 1;
+    auto middle = chrono::steady_clock::now();
+    for (long i = 0; i < count; i += 2) {
+        PROFILE_ZONE("Outer");
+        {
+            PROFILE_ZONE("Inner");
+            sink = sink + 1;
+        }
+        sink = sink + 1;
+    }
+    auto end = chrono::steady_clock::now();
+    for (long i = 0; i < count; i++)
+        sink = sink + (int) profileTicks();
+    auto ticks = chrono::steady_clock::now();
+
+    double baseline = chrono::duration<double, nano>(middle - start).count();
+    double zoned = chrono::duration<double, nano>(end - middle).count();
+    double reads = chrono::duration<double, nano>(ticks - end).count();
+    cout << count << " zones: " << (zoned - baseline) / count << "ns per zone" << (PROFILER ? "" : " (compiled out)")
+         << ", of which ~" << 2 * (reads - baseline) / count << "ns reading the ticks" << endl;
+
+    profileFrame();
+    { PROFILE_ZONE("Frame"); }
+    if (writeFrameTrace(TRACE_PATH, 1)) cout << "Wrote " << TRACE_PATH << endl;
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Measures the per-frame transform update of the structure of arrays store (see src/Transforms.h) against the
+// same work done the way objects used to, each on its own heap allocation through a virtual call
+//   usage: transformbench [entities]
+// Both compute each entity's spinning model matrix, world space bounding sphere & frustum test; the results
+// are compared so the vectorized math is checked too
+
+#include "../src/Transforms.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Configurable settings
+static const int WARMUP_FRAMES = 10;
+static const int FRAMES = 100;
+
+// An object as they were laid out before the store: the transform fields inline with the GL handles & the rest
+class Entity {
+public:
+    virtual ~Entity() {};
+    virtual void update(double time, const glm::vec4* frustum) = 0;
+
+    unsigned int program, vao, resources[6];
+    double start;
+    bool lit;
+    float position[3];
+    float size;
+    float axis[3];
+    float speed;
+    float center[3], radius;
+
+    float model[16];
+    bool visible;
+};
+
+class SpinningEntity : public Entity {
+public:
+    void update(double time, const glm::vec4* frustum) override {
+        float angle = (float) (time - start) * speed * 2.0f * (float) M_PI;
+        float c = cos(angle), s = sin(angle), t = 1 - c;
+        float x = axis[0], y = axis[1], z = axis[2];
+        float r[9] = { t * x * x + c,     t * x * y + s * z, t * x * z - s * y,
+                       t * x * y - s * z, t * y * y + c,     t * y * z + s * x,
+                       t * x * z + s * y, t * y * z - s * x, t * z * z + c };
+        for (int col = 0; col < 3; col++) {
+            for (int row = 0; row < 3; row++) model[col * 4 + row] = r[col * 3 + row] * size;
+            model[col * 4 + 3] = 0;
+        }
+        for (int row = 0; row < 3; row++) model[12 + row] = position[row];
+        model[15] = 1;
+
+        float world[3];
+        for (int row = 0; row < 3; row++)
+            world[row] = model[12 + row] + model[row] * center[0] + model[4 + row] * center[1] + model[8 + row] * center[2];
+        visible = true;
+        for (int p = 0; p < 6; p++)
+            if (frustum[p].x * world[0] + frustum[p].y * world[1] + frustum[p].z * world[2] + frustum[p].w < -radius * size)
+                visible = false;
+    }
+};
+
+static double milliseconds(chrono::high_resolution_clock::duration d) {
+    return chrono::duration<double, milli>(d).count();
+}
+
+int main(int argc, char** argv) {
+    size_t count = (argc > 1) ? stoul(argv[1]) : 100000;
+
+    // The same entities both ways. The objects are allocated between other allocations, like a scene's are
+    mt19937 random(1);
+    uniform_real_distribution<float> coordinate(-100.0f, 100.0f), unit(0.0f, 1.0f);
+    vector<unique_ptr<Entity>> entities;
+    vector<unique_ptr<char[]>> clutter;
+    TransformStore store;
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 position(coordinate(random), coordinate(random) * 0.1f, coordinate(random));
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f));
+        float size = 0.5f + unit(random), speed = 0.1f + unit(random), radius = 0.87f;
+
+        Entity* e = new SpinningEntity();
+        e->start = 0;
+        e->position[0] = position.x; e->position[1] = position.y; e->position[2] = position.z;
+        e->axis[0] = axis.x; e->axis[1] = axis.y; e->axis[2] = axis.z;
+        e->size = size;
+        e->speed = speed;
+        e->center[0] = e->center[1] = e->center[2] = 0;
+        e->radius = radius;
+        entities.emplace_back(e);
+        clutter.emplace_back(new char[64 + (size_t) (unit(random) * 1024)]);
+
+        uint32_t t = store.add(0.0);
+        store.setPosition(t, position);
+        store.setScale(t, size);
+        store.setRotation(t, axis, speed);
+        store.setBounds(t, glm::vec3(0.0f), radius);
+    }
+
+    // A frustum looking down -z from the origin (near 0.1, far 300, 90 degrees)
+    glm::vec4 frustum[6] = { glm::vec4(1, 0, -1, 0), glm::vec4(-1, 0, -1, 0), glm::vec4(0, 1, -1, 0),
+                             glm::vec4(0, -1, -1, 0), glm::vec4(0, 0, -1, -0.1f), glm::vec4(0, 0, 1, 300) };
+    for (auto& it : frustum) it /= glm::length(glm::vec3(it.x, it.y, it.z));
+
+    double objectsTime = 0, storeTime = 0;
+    for (int frame = 0; frame < WARMUP_FRAMES + FRAMES; frame++) {
+        double time = frame / 60.0;
+
+        auto start = chrono::high_resolution_clock::now();
+        for (auto& it : entities) it->update(time, frustum);
+        auto middle = chrono::high_resolution_clock::now();
+        store.update(0, store.size(), time, frustum);
+        auto end = chrono::high_resolution_clock::now();
+
+        if (frame >= WARMUP_FRAMES) {
+            objectsTime += milliseconds(middle - start);
+            storeTime += milliseconds(end - middle);
+        }
+    }
+
+    // Compare the last frame
+    float maxError = 0;
+    size_t visible = 0, mismatches = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        glm::mat4 model = store.model(i);
+        for (int col = 0; col < 4; col++)
+            for (int row = 0; row < 4; row++)
+                maxError = max(maxError, fabs(model[col][row] - entities[i]->model[col * 4 + row]));
+        visible += store.visible(i);
+        mismatches += store.visible(i) != entities[i]->visible;
+    }
+
+    cout << count << " entities, " << visible << " visible (" << mismatches << " frustum tests differ), max matrix error "
+         << maxError << endl;
+    cout << "Objects: " << objectsTime / FRAMES << "ms per frame" << endl;
+    cout << "Store:   " << storeTime / FRAMES << "ms per frame (" << objectsTime / storeTime << "x)" << endl;
+    return 0;
+}